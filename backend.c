@@ -0,0 +1,51 @@
+/* File: backend.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <backend.h>
+
+/* global variables */
+static const backend_t *backends[] =
+{
+  &backend_console,
+  &backend_evdev,
+  &backend_sysfs,
+  &backend_mock,
+  NULL
+};
+
+/* backend_find - look up a backend by name, ignoring any ":arg" */
+const backend_t *
+backend_find (const char *name)
+{
+  size_t len = strcspn (name, ":");
+  int    i;
+
+  for (i = 0; backends[i] != NULL; i++)
+  {
+    if (strlen (backends[i]->name) == len &&
+        !strncmp (backends[i]->name, name, len))
+    {
+      return backends[i];
+    }
+  }
+  return NULL;
+}
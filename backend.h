@@ -0,0 +1,48 @@
+/* File: backend.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* LED backends of blinkd.  A backend drives the LEDs of one device
+   with a mask of the KDSETLED bits LED_CAP, LED_NUM and LED_SCR.
+   Operations return -1 and set errno on errors.  blinkd caches the
+   state, so read is only called after opening or when the state may
+   have been changed by others, and apply only when anything changes.
+   Backends driving panel LEDs besides the keyboard ones switch them
+   one by one with set, numbered from 0; blinkd calls it only when an
+   LED changes.  watch, hotplug and set may be NULL. */
+
+#define BACKEND_VT      0x01    /* device follows the foreground tty */
+
+typedef struct {
+  const char *name;
+  int         flags;
+  int  (*open)    (const char *arg); /* arg is NULL or from name:arg */
+  int  (*apply)   (int mask);
+  int  (*read)    (void);            /* returns the mask */
+  int  (*close)   (void);
+  int  (*release) (void);            /* give the LEDs back on exit */
+  int  (*watch)   (void);            /* fd to poll for hotplug, or -1 */
+  int  (*hotplug) (void);            /* called when watch is readable */
+  int  (*set)     (int panel, int on);
+} backend_t;
+
+extern const backend_t backend_console;
+extern const backend_t backend_evdev;
+extern const backend_t backend_sysfs;
+extern const backend_t backend_mock;
+
+const backend_t *backend_find (const char *name);
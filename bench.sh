@@ -0,0 +1,102 @@
+#!/bin/sh
+# File: bench.sh
+# Run blink-bench against a private blinkd with the mock LED backend.
+# Every case prints one JSON object per line, so the output can be
+# kept and compared across releases.  Usage: bench.sh [builddir]
+
+dir=${1:-.}
+port=${BENCH_PORT:-20912}
+name=@blinkd-bench.$$
+shm=/blinkd-bench.$$
+count=${BENCH_COUNT:-20000}
+edges=${TMPDIR:-/tmp}/blinkd-bench.$$.edges
+jitter_s=${BENCH_JITTER:-10}
+
+start ()
+{
+  "$dir/blinkd" --foreground --backend=${backend:-mock} --tcp-port=$port \
+    --udp-port=$port --unix-socket=$name.socket --dgram-socket=$name.dgram \
+    --state=$shm.state --ring=$shm.ring "$@" &
+  pid=$!
+  sleep 1
+}
+
+trap 'kill $pid $load 2>/dev/null; rm -f $edges' 0 1 2 15
+start
+
+bench ()
+{
+  "$dir/blink-bench" --json --tcp-port=$port --query=$name.socket "$@" ||
+    exit 1
+}
+
+for clients in 1 8; do
+  bench --transport=tcp --clients=$clients --count=$count
+  bench --transport=unix --unix-socket=$name.socket \
+    --clients=$clients --count=$count
+  bench --transport=tcp --oneshot --clients=$clients --count=$count
+  bench --transport=unix --unix-socket=$name.socket --oneshot \
+    --clients=$clients --count=$count
+done
+bench --transport=tcp --clients=8 --batch=64 --count=$count
+bench --transport=tcp --clients=8 --mix=0:45:45:10 --count=$count
+bench --transport=tcp --clients=8 --rate=1000 --time=2
+bench --transport=udp --clients=4 --batch=16 --count=$count
+bench --transport=dgram --unix-socket=$name.dgram --clients=4 --batch=16 \
+  --count=$count
+
+# the shared memory ring against the local sockets, for throughput and
+# for the time a single change takes to wake up an idle blinkd
+for clients in 1 4; do
+  bench --transport=ring --unix-socket=$shm.ring --clients=$clients \
+    --count=$((count * 10))
+  bench --transport=dgram --unix-socket=$name.dgram --clients=$clients \
+    --count=$((count * 10))
+done
+bench --transport=ring --unix-socket=$shm.ring --clients=4 --batch=16 \
+  --count=$((count * 10))
+bench --wake --state=$shm.state --transport=ring --unix-socket=$shm.ring \
+  --count=1000
+bench --wake --state=$shm.state --transport=dgram \
+  --unix-socket=$name.dgram --count=1000
+bench --wake --state=$shm.state --transport=unix \
+  --unix-socket=$name.socket --count=1000
+bench --wake --state=$shm.state --transport=tcp --count=1000
+
+# connection rate with the number of acceptor threads
+for acceptors in 1 2 4; do
+  kill $pid
+  wait $pid 2>/dev/null
+  start --acceptors=$acceptors
+  bench --transport=tcp --oneshot --clients=8 --count=$count |
+    sed "s/^{/{\"acceptors\": $acceptors, /"
+done
+
+# edge times of Caps-Lock blinking with millisecond times against the
+# pattern, idle, with all CPUs busy and with Scroll-Lock changed over
+# udp as fast as possible
+times="--on-time=20ms --off-time=30ms --pause=100ms"
+kill $pid
+wait $pid 2>/dev/null
+for kind in idle cpu network; do
+  backend=mock:$edges start $times
+  "$dir/blink" --unix-socket=$name.socket --capslockled --rate=3 || exit 1
+  load=
+  case $kind in
+    cpu)
+      for cpu in $(seq $(getconf _NPROCESSORS_ONLN)); do
+        sh -c 'while :; do :; done' &
+        load="$load $!"
+      done;;
+    network)
+      "$dir/blink-bench" --transport=udp --tcp-port=$port --led=scroll \
+        --mix=70:15:15:0 --clients=4 --time=$jitter_s >/dev/null &
+      load=$!;;
+  esac
+  sleep $jitter_s
+  kill $load 2>/dev/null
+  kill $pid
+  wait $pid $load 2>/dev/null
+  "$dir/jitter-bench" --json $times --rate=3 $edges |
+    sed "s/^{/{\"load\": \"$kind\", /"
+done
@@ -0,0 +1,828 @@
+/* File: blink-bench.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Load generator for blinkd.  Every client thread sends rounds of
+   commands, on stream sockets each round ends with BLINKD_PING and the
+   time until the reply is the latency of the round.  Datagrams have no
+   reply, their loss is taken from the octets_decoded counter of the
+   server instead, just as for records pushed into the command ring.
+   With --wake a single client measures how long a change takes from
+   being sent to an idle blinkd until its shared state shows it.
+   Results are "name value" lines or one JSON object. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include <blinkd.h>
+#include <libblink.h>
+#include <ringpush.h>
+
+/* macros */
+#define SERV_HOST   "localhost"
+#define RATE_ABS    10          /* absolute rates are drawn from 0..9 */
+#define SAMPLES_MIN 4096
+#define DRAIN_USEC  200000      /* let blinkd catch up before counting */
+#define WAKE_GAP_US 2000        /* let blinkd fall asleep between samples */
+#define WAKE_MAX_NS 1000000000UL /* give up on a change after that */
+
+typedef enum {T_TCP, T_UNIX, T_UDP, T_DGRAM, T_RING} transport_t;
+
+typedef struct
+{
+  pthread_t      thread;
+  unsigned int   seed;
+  unsigned long  commands;      /* sent */
+  unsigned long  dropped;       /* failed connects and lost streams */
+  unsigned long *samples;       /* round trip times in ns */
+  size_t         nsamples;
+  size_t         size;
+} client_t;
+
+/* function prototypes */
+static void           add_sample     (client_t *, unsigned long);
+static int            connect_target (const struct sockaddr *, socklen_t,
+                                      int);
+static void          *client         (void *);
+static int            cmp_ulong      (const void *, const void *);
+static unsigned char  next_command   (client_t *);
+static unsigned long  now_ns         (void);
+static long           octets_decoded (void);
+static unsigned long  percentile     (const unsigned long *, size_t, int);
+static void           process_opts   (int, char **);
+static void           report         (client_t *, double, long);
+static int            round_trip     (int, const unsigned char *, size_t);
+static void           set_target     (struct sockaddr_storage *,
+                                      socklen_t *, transport_t,
+                                      const char *);
+static void           usage          (char *);
+static void           wake_client    (client_t *);
+static void           wrong_use      (char *);
+
+/* global variables */
+static const char *transport_names[] = {"tcp", "unix", "udp", "dgram",
+                                        "ring"};
+static const char *led_names[]       = {"caps", "num", "scroll"};
+static transport_t transport      = T_TCP;
+static int         persistent     = 1;
+static int         clients        = 4;
+static unsigned long count        = 10000; /* commands per client */
+static int         duration       = 0;     /* seconds, overrides count */
+static unsigned long rate         = 0;     /* commands/s per client */
+static int         batch          = 1;     /* commands per round */
+static int         mix[4]         = {70, 10, 10, 10}; /* abs:inc:dec:reset */
+static int         mix_total      = 100;
+static int         only_led       = -1;    /* the one LED to change */
+static int         json           = 0;
+static char       *server         = SERV_HOST;
+static short       serv_tcp_port  = SERV_TCP_PORT;
+static char       *path           = NULL;  /* local socket */
+static char       *query_path     = NULL;  /* local stream socket for stats */
+static int         stop           = 0;
+static int         wake           = 0;     /* measure wake latency */
+static char       *state_name     = NULL;  /* shared state of blinkd */
+static ringpush_t  ring;
+
+static struct sockaddr_storage target;
+static socklen_t               target_len;
+static int                     target_type;
+
+/* main - start the clients, wait for them, report */
+int
+main (int argc,
+      char **argv)
+{
+  client_t     *cl;
+  long          before = -1;
+  long          after  = -1;
+  unsigned long start;
+  double        elapsed;
+  int           i;
+
+  process_opts (argc, argv);
+  if (transport == T_RING)
+  {
+    if (ringpush_map (&ring, path) == -1)
+    {
+      fprintf (stderr, "Cannot map ring %s: %s\n",
+               path? path: BLINKD_RING_NAME,
+               errno == EPROTO? "unknown ring": strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    set_target (&target, &target_len, transport, path);
+  }
+  target_type = (transport == T_UDP || transport == T_DGRAM)?
+                SOCK_DGRAM: SOCK_STREAM;
+  if ((target_type == SOCK_DGRAM || transport == T_RING) && !wake)
+  {
+    before = octets_decoded ();
+  }
+  if ((cl = calloc (clients, sizeof (client_t))) == NULL)
+  {
+    perror ("calloc");
+    exit (EXIT_FAILURE);
+  }
+  start = now_ns ();
+  if (wake)
+  {
+    wake_client (cl);
+    report (cl, (now_ns () - start) / 1e9, -1);
+    return EXIT_SUCCESS;
+  }
+  for (i = 0; i < clients; i++)
+  {
+    cl[i].seed = 0x5eed + i;
+    if (pthread_create (&cl[i].thread, NULL, client, &cl[i]))
+    {
+      perror ("pthread_create");
+      exit (EXIT_FAILURE);
+    }
+  }
+  if (duration)
+  {
+    sleep (duration);
+    __atomic_store_n (&stop, 1, __ATOMIC_RELAXED);
+  }
+  for (i = 0; i < clients; i++)
+  {
+    pthread_join (cl[i].thread, NULL);
+  }
+  elapsed = (now_ns () - start) / 1e9;
+  if (before != -1)
+  {
+    usleep (DRAIN_USEC);
+    if ((after = octets_decoded ()) != -1)
+    {
+      after -= before + 1;      /* the query octet itself */
+    }
+  }
+  report (cl, elapsed, after);
+  return EXIT_SUCCESS;
+}
+
+/* client - one load generating thread
+
+   Rounds are paced against absolute deadlines, so a late round does
+   not push all later ones back.
+*/
+static void *
+client (void *arg)
+{
+  client_t       *cl   = arg;
+  unsigned char   buf[BLINKD_DGRAM_MAX + 1];
+  struct timespec next;
+  unsigned long   interval = 0;
+  unsigned long   sent     = 0;
+  int             sockfd   = -1;
+
+  if (rate)
+  {
+    interval = 1000000000UL / rate * batch;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &next);
+  while (duration? !__atomic_load_n (&stop, __ATOMIC_RELAXED): sent < count)
+  {
+    size_t        len = 0;
+    unsigned long t0;
+
+    while ((int) len < batch && (duration || sent + len < count))
+    {
+      buf[len++] = next_command (cl);
+    }
+    sent += len;
+    if (interval)
+    {
+      clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+      next.tv_nsec += interval;
+      next.tv_sec  += next.tv_nsec / 1000000000L;
+      next.tv_nsec %= 1000000000L;
+    }
+    t0 = now_ns ();
+    if (transport == T_RING)
+    {
+      while (ringpush_push (&ring, buf, len) == -1)
+      {
+        sched_yield ();         /* full, let blinkd catch up */
+      }
+      cl->commands += len;
+      continue;
+    }
+    if (sockfd == -1 &&
+        (sockfd = connect_target ((struct sockaddr *) &target, target_len,
+                                  target_type)) == -1)
+    {
+      cl->dropped++;
+      continue;
+    }
+    if (target_type == SOCK_DGRAM)
+    {
+      if (send (sockfd, buf, len, 0) == (ssize_t) len)
+      {
+        cl->commands += len;
+      }
+    }
+    else
+    {
+      buf[len] = BLINKD_PING;
+      if (round_trip (sockfd, buf, len + 1))
+      {
+        cl->dropped++;
+        close (sockfd);
+        sockfd = -1;
+        continue;
+      }
+      cl->commands += len;
+      add_sample (cl, now_ns () - t0);
+    }
+    if (!persistent)
+    {
+      close (sockfd);
+      sockfd = -1;
+    }
+  }
+  if (sockfd != -1)
+  {
+    close (sockfd);
+  }
+  return NULL;
+}
+
+/* wake_client - time single changes from sending until blinkd shows them
+
+   The Caps-Lock rate alternates between 1 and 2, so every command is a
+   change.  Between samples blinkd gets the time to go idle, so each
+   one pays for waking it up.
+*/
+static void
+wake_client (client_t *cl)
+{
+  blink_state_t  *st;
+  blink_status_t  status;
+  unsigned long   i;
+  int             sockfd = -1;
+
+  if ((st = blink_state_open (state_name)) == NULL)
+  {
+    perror ((state_name != NULL)? state_name: "blink_state_open");
+    exit (EXIT_FAILURE);
+  }
+  for (i = 0; i < count; i++)
+  {
+    unsigned char c = (BLINKD_CAP << 6) | (1 + i % 2);
+    unsigned long t0;
+    int           sent;
+
+    if (transport != T_RING && sockfd == -1 &&
+        (sockfd = connect_target ((struct sockaddr *) &target, target_len,
+                                  target_type)) == -1)
+    {
+      cl->dropped++;
+      continue;
+    }
+    t0 = now_ns ();
+    sent = (transport == T_RING)? ringpush_push (&ring, &c, 1) == 0:
+           send (sockfd, &c, 1, MSG_NOSIGNAL) == 1;
+    if (!sent)
+    {
+      cl->dropped++;
+      continue;
+    }
+    cl->commands++;
+    while (blink_state_read (st, &status) == 0 &&
+           status.rate[BLINK_CAP] != 1 + (int) (i % 2) &&
+           now_ns () - t0 < WAKE_MAX_NS)
+    {
+    }
+    add_sample (cl, now_ns () - t0);
+    usleep (WAKE_GAP_US);
+  }
+  if (sockfd != -1)
+  {
+    close (sockfd);
+  }
+  blink_state_close (st);
+}
+
+/* add_sample - keep a latency sample of a client */
+static void
+add_sample (client_t *cl,
+            unsigned long ns)
+{
+  if (cl->nsamples == cl->size)
+  {
+    cl->size    = cl->size? 2 * cl->size: SAMPLES_MIN;
+    cl->samples = realloc (cl->samples, cl->size * sizeof (long));
+    if (cl->samples == NULL)
+    {
+      perror ("realloc");
+      exit (EXIT_FAILURE);
+    }
+  }
+  cl->samples[cl->nsamples++] = ns;
+}
+
+/* next_command - draw a command octet from the configured mix */
+static unsigned char
+next_command (client_t *cl)
+{
+  int r   = rand_r (&cl->seed) % mix_total;
+  int led = (only_led != -1)? only_led: rand_r (&cl->seed) % BLINKD_ALL;
+
+  if ((r -= mix[0]) < 0)
+  {
+    return (unsigned char) ((led << 6) | (rand_r (&cl->seed) % RATE_ABS));
+  }
+  if ((r -= mix[1]) < 0)
+  {
+    return (unsigned char) ((led << 6) | RATE_INC);
+  }
+  if ((r -= mix[2]) < 0)
+  {
+    return (unsigned char) ((led << 6) | RATE_DEC);
+  }
+  return (unsigned char) (BLINKD_ALL << 6);
+}
+
+/* round_trip - send a round and wait for the reply to its ping */
+static int
+round_trip (int sockfd,
+            const unsigned char *buf,
+            size_t len)
+{
+  char    reply;
+  ssize_t rr;
+
+  while (len)
+  {
+    ssize_t wr = send (sockfd, buf, len, MSG_NOSIGNAL);
+
+    if (wr == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    buf += wr;
+    len -= wr;
+  }
+  while ((rr = read (sockfd, &reply, 1)) == -1 && errno == EINTR)
+  {
+  }
+  return (rr == 1 && reply == '\n')? 0: -1;
+}
+
+/* connect_target - open a socket of the given type to the server */
+static int
+connect_target (const struct sockaddr *addr,
+                socklen_t addrlen,
+                int type)
+{
+  int sockfd;
+
+  if ((sockfd = socket (addr->sa_family, type, 0)) == -1)
+  {
+    return -1;
+  }
+  if (connect (sockfd, addr, addrlen) == -1)
+  {
+    close (sockfd);
+    return -1;
+  }
+  return sockfd;
+}
+
+/* set_target - resolve the server address for a transport
+
+   Local socket names starting with "@" are abstract.
+*/
+static void
+set_target (struct sockaddr_storage *addr,
+            socklen_t *addrlen,
+            transport_t t,
+            const char *name)
+{
+  memset (addr, 0, sizeof (*addr));
+  if (t == T_UNIX || t == T_DGRAM)
+  {
+    struct sockaddr_un *sa_un = (struct sockaddr_un *) addr;
+    size_t              len;
+
+    if (name == NULL)
+    {
+      name = (t == T_DGRAM)? BLINKD_DGRAM_PATH: BLINKD_SOCKET_PATH;
+    }
+    if (!(len = strlen (name)) || len >= sizeof (sa_un->sun_path))
+    {
+      fprintf (stderr, "Bad socket name %s.\n", name);
+      exit (EXIT_FAILURE);
+    }
+    sa_un->sun_family = AF_UNIX;
+    memcpy (sa_un->sun_path, name, len);
+    *addrlen = offsetof (struct sockaddr_un, sun_path) + len;
+    if (*name == '@')
+    {
+      sa_un->sun_path[0] = '\0';
+    }
+    else
+    {
+      (*addrlen)++;
+    }
+  }
+  else
+  {
+    struct sockaddr_in *sin = (struct sockaddr_in *) addr;
+    struct hostent     *hostinfo;
+
+    if ((hostinfo = gethostbyname (server)) == NULL)
+    {
+      fprintf (stderr, "Unknown host %s.\n", server);
+      exit (EXIT_FAILURE);
+    }
+    sin->sin_family = AF_INET;
+    sin->sin_port   = htons (serv_tcp_port);
+    sin->sin_addr   = *(struct in_addr *) hostinfo->h_addr;
+    *addrlen = sizeof (*sin);
+  }
+}
+
+/* octets_decoded - ask the server how many octets it decoded so far
+
+   Uses the local stream socket given with --query, else tcp.
+   Returns -1 if the server cannot be asked.
+*/
+static long
+octets_decoded (void)
+{
+  struct sockaddr_storage addr;
+  socklen_t               addrlen;
+  unsigned char           octet = BLINKD_QUERY_STATS;
+  char                    buf[4096];
+  size_t                  len   = 0;
+  ssize_t                 rr;
+  char                   *p;
+  int                     sockfd;
+
+  set_target (&addr, &addrlen, query_path? T_UNIX: T_TCP, query_path);
+  if ((sockfd = connect_target ((struct sockaddr *) &addr, addrlen,
+                                SOCK_STREAM)) == -1)
+  {
+    return -1;
+  }
+  if (write (sockfd, &octet, 1) != 1)
+  {
+    close (sockfd);
+    return -1;
+  }
+  shutdown (sockfd, SHUT_WR);
+  while (len < sizeof (buf) - 1 &&
+         (rr = read (sockfd, buf + len, sizeof (buf) - 1 - len)) > 0)
+  {
+    len += rr;
+  }
+  close (sockfd);
+  buf[len] = '\0';
+  if ((p = strstr (buf, "octets_decoded ")) == NULL)
+  {
+    return -1;
+  }
+  return strtol (p + strlen ("octets_decoded "), NULL, 10);
+}
+
+/* report - merge the samples of all clients and print the results */
+static void
+report (client_t *cl,
+        double elapsed,
+        long decoded)
+{
+  unsigned long *all;
+  unsigned long  commands = 0;
+  unsigned long  dropped  = 0;
+  size_t         n        = 0;
+  long           lost     = 0;
+  const char    *mode     = wake? "wake": persistent? "persistent":
+                                                      "oneshot";
+  int            i;
+
+  for (i = 0; i < clients; i++)
+  {
+    n += cl[i].nsamples;
+  }
+  if ((all = malloc ((n + 1) * sizeof (long))) == NULL)
+  {
+    perror ("malloc");
+    exit (EXIT_FAILURE);
+  }
+  for (n = 0, i = 0; i < clients; i++)
+  {
+    memcpy (all + n, cl[i].samples, cl[i].nsamples * sizeof (long));
+    n        += cl[i].nsamples;
+    commands += cl[i].commands;
+    dropped  += cl[i].dropped;
+  }
+  qsort (all, n, sizeof (long), cmp_ulong);
+  if (decoded != -1)
+  {
+    lost = (long) commands - decoded;
+  }
+  if (json)
+  {
+    printf ("{\"transport\": \"%s\", \"mode\": \"%s\", \"clients\": %d, "
+            "\"batch\": %d, \"commands\": %lu, \"round_trips\": %lu, "
+            "\"elapsed_s\": %.3f, \"throughput_cps\": %.0f, "
+            "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, "
+            "\"p999\": %.1f, \"max\": %.1f}, "
+            "\"dropped_connections\": %lu, \"lost_datagrams\": %ld}\n",
+            transport_names[transport], mode, clients, batch,
+            commands, (unsigned long) n, elapsed, commands / elapsed,
+            percentile (all, n, 500) / 1e3, percentile (all, n, 990) / 1e3,
+            percentile (all, n, 999) / 1e3, percentile (all, n, 1000) / 1e3,
+            dropped, lost);
+  }
+  else
+  {
+    printf ("transport %s\n"
+            "mode %s\n"
+            "clients %d\n"
+            "batch %d\n"
+            "commands %lu\n"
+            "round_trips %lu\n"
+            "elapsed_s %.3f\n"
+            "throughput_cps %.0f\n"
+            "latency_p50_us %.1f\n"
+            "latency_p99_us %.1f\n"
+            "latency_p999_us %.1f\n"
+            "latency_max_us %.1f\n"
+            "dropped_connections %lu\n"
+            "lost_datagrams %ld\n",
+            transport_names[transport], mode, clients, batch,
+            commands, (unsigned long) n, elapsed, commands / elapsed,
+            percentile (all, n, 500) / 1e3, percentile (all, n, 990) / 1e3,
+            percentile (all, n, 999) / 1e3, percentile (all, n, 1000) / 1e3,
+            dropped, lost);
+  }
+  free (all);
+}
+
+/* percentile - per mille value of sorted samples, 1000 is the maximum */
+static unsigned long
+percentile (const unsigned long *v,
+            size_t n,
+            int permille)
+{
+  size_t i;
+
+  if (!n)
+  {
+    return 0;
+  }
+  i = (size_t) ((double) n * permille / 1000);
+  return v[(i < n)? i: n - 1];
+}
+
+/* cmp_ulong - qsort helper */
+static int
+cmp_ulong (const void *a,
+           const void *b)
+{
+  unsigned long x = *(const unsigned long *) a;
+  unsigned long y = *(const unsigned long *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* now_ns - monotonic clock in nanoseconds */
+static unsigned long
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* process_opts - process command line, see function usage() for options */
+static void
+process_opts (int argc,
+              char **argv)
+{
+  int c = 0;
+
+  while (1)
+  {
+    int option_index                    = 0;
+    static struct option long_options[] =
+    {
+      {"batch",         1, 0, 'b'},
+      {"clients",       1, 0, 'c'},
+      {"help",          0, 0, 'h'},
+      {"json",          0, 0, 'j'},
+      {"led",           1, 0, 'l'},
+      {"machine",       1, 0, 'm'},
+      {"mix",           1, 0, 'x'},
+      {"count",         1, 0, 'n'},
+      {"oneshot",       0, 0, 'o'},
+      {"query",         1, 0, 'q'},
+      {"rate",          1, 0, 'r'},
+      {"state",         1, 0, 'S'},
+      {"time",          1, 0, 'T'},
+      {"tcp-port",      1, 0, 't'},
+      {"unix-socket",   1, 0, 'u'},
+      {"version",       0, 0, 'v'},
+      {"wake",          0, 0, 'W'},
+      {"transport",     1, 0, 'X'},
+      {0,               0, 0, 0}
+    };
+    c = getopt_long (argc, argv, "b:c:hjl:m:n:oq:r:S:T:t:u:vWX:x:",
+                     long_options, &option_index);
+    if (c == -1)
+    {
+      break;
+    }
+    switch (c)
+    {
+      case 'b':
+        if ((batch = atoi (optarg)) < 1 || batch > BLINKD_DGRAM_MAX)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'c':
+        if ((clients = atoi (optarg)) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'h':
+        usage (argv[0]);
+        exit (EXIT_SUCCESS);
+      case 'j':
+        json = 1;
+        break;
+      case 'l':
+        for (c = BLINKD_CAP; c < BLINKD_ALL; c++)
+        {
+          if (!strcmp (optarg, led_names[c]))
+          {
+            break;
+          }
+        }
+        if (c == BLINKD_ALL)
+        {
+          wrong_use (argv[0]);
+        }
+        only_led = c;
+        break;
+      case 'm':
+        server = optarg;
+        break;
+      case 'n':
+        count = strtoul (optarg, NULL, 0);
+        break;
+      case 'o':
+        persistent = 0;
+        break;
+      case 'q':
+        query_path = optarg;
+        break;
+      case 'r':
+        rate = strtoul (optarg, NULL, 0);
+        break;
+      case 'S':
+        state_name = optarg;
+        break;
+      case 'T':
+        if ((duration = atoi (optarg)) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 't':
+        serv_tcp_port = atoi (optarg);
+        break;
+      case 'u':
+        path = optarg;
+        break;
+      case 'v':
+        printf ("blink-bench (%s) %s\n", PACKAGE, VERSION);
+        exit (EXIT_SUCCESS);
+      case 'W':
+        wake = 1;
+        break;
+      case 'X':
+        for (c = T_TCP; c <= T_RING; c++)
+        {
+          if (!strcmp (optarg, transport_names[c]))
+          {
+            break;
+          }
+        }
+        if (c > T_RING)
+        {
+          wrong_use (argv[0]);
+        }
+        transport = c;
+        break;
+      case 'x':
+        if (sscanf (optarg, "%d:%d:%d:%d",
+                    &mix[0], &mix[1], &mix[2], &mix[3]) != 4 ||
+            mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[3] < 0 ||
+            (mix_total = mix[0] + mix[1] + mix[2] + mix[3]) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      default:
+        wrong_use (argv[0]);
+    }
+  }
+  if (optind < argc)
+  {
+    wrong_use (argv[0]);
+  }
+  /* a record holds what a datagram does, but less of it */
+  if (transport == T_RING && batch > BLINKD_RING_DATA)
+  {
+    wrong_use (argv[0]);
+  }
+  /* one change at a time, no load */
+  if (wake && (duration || rate || !persistent))
+  {
+    wrong_use (argv[0]);
+  }
+  if (wake)
+  {
+    clients = 1;
+    batch   = 1;
+  }
+}
+
+/* usage - help on options */
+static void
+usage (char* name)
+{
+  printf ("Usage: %s [options]\n"
+          "Options are\n"
+          "  -b k, --batch=k       send k commands per round (1)\n"
+          "  -c n, --clients=n     run n concurrent clients (4)\n"
+          "  -h,   --help          display this help and exit\n"
+          "  -j,   --json          print the results as JSON\n"
+          "  -l l, --led=l         change only LED caps, num or scroll\n"
+          "  -m s, --machine=s     load blinkd on machine s\n"
+          "  -n n, --count=n       send n commands per client (10000)\n",
+          name);
+  fputs ("  -o,   --oneshot       use a new socket for every round\n"
+         "  -q s, --query=s       ask local socket s for statistics\n"
+         "  -r n, --rate=n        send n commands/s per client (no limit)\n"
+         "  -S s, --state=s       watch the shared state s for --wake\n"
+         "  -T s, --time=s        run for s seconds instead of a count\n"
+         "  -t n, --tcp-port=n    use tcp or udp port n\n"
+         "  -u s, --unix-socket=s use local socket or ring s\n",
+         stdout);
+  fputs ("  -v,   --version       output version information and exit\n"
+         "  -W,   --wake          time single changes to an idle blinkd\n"
+         "  -X t, --transport=t   use tcp, unix, udp, dgram or ring (tcp)\n"
+         "  -x m, --mix=a:i:d:r   weigh absolute rates, increments,\n"
+         "                        decrements and resets (70:10:10:10)\n",
+         stdout);
+}
+
+/* wrong_use - output for the user, if options cannot be interpreted */
+static void
+wrong_use (char *name)
+{
+  fprintf (stderr, "%s: Error in arguments.  Try %s --help.\n", name, name);
+  exit (EXIT_FAILURE);
+}
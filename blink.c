@@ -24,42 +24,89 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <libintl.h>
 #include <locale.h>
 
 #include <blinkd.h>
+#include <libblink.h>
 
 /* macros */
-#define SERV_HOST "localhost"
-#define RATE_MAX (RATE_INC - 1)
+#define BATCH_BUFSIZE 4096      /* input line buffer */
+#define STATS_BUFSIZE 65536
+#define RESOLVE_POLL  10        /* ms between looks at the resolver */
+#define HOST_RESOLVING 0
+#define HOST_SENDING   1
+#define HOST_DONE      2
 
 /* gettext macros */
 #define _(String) gettext (String)
 
+/* type definitions */
+typedef struct {
+  char           *name;         /* as given */
+  char           *host;
+  int             port;         /* 0 for the default */
+  char            service[16];
+  struct addrinfo hints;
+  struct gaicb    req;
+  blink_t        *b;
+  int             state;        /* HOST_RESOLVING, _SENDING or _DONE */
+  const char     *error;        /* why it failed, NULL if it did not */
+} machine_t;
+
 /* function prototypes */
-static int  connect_server (void);
-static void process_opts   (int , char **);
-static void send_rate      (int);
-static void usage          (char *);
-static void wrong_use      (char *);
-static void init_sockaddr  (struct sockaddr_in *, const char *, short);
+static void          add_machines   (char *);
+static long          elapsed_ms     (const struct timespec *);
+static void          fail           (const char *);
+static int           fan_out        (void);
+static void          machine_open   (machine_t *);
+static void          machine_result (machine_t *, int);
+static int           parse_command  (blink_t *, char *);
+static void          process_opts   (int , char **);
+static int           queue_rate     (blink_t *);
+static void          read_machines  (const char *);
+static int           send_batch     (blink_t *);
+static void          send_rate      (blink_t *);
+static int           show_stats     (blink_t *);
+static int           show_status    (void);
+static int           split_port     (char *);
+static void          usage          (char *);
+static void          wrong_use      (char *);
 
 /* global variables */
-static short serv_tcp_port = SERV_TCP_PORT;
+static int   serv_tcp_port = 0;    /* 0: local socket first, then tcp */
 static int   led           = BLINKD_ALL;
 static int   rate          = 0;
+static int   delta         = 0;    /* +1 or -1 for --rate=+ or - */
 static char *server        = NULL;
+static char *batch         = NULL; /* command file, "-" is stdin */
+static char *unix_path     = NULL; /* local socket given by the user */
+static int   open_flags    = 0;    /* BLINK_DATAGRAM, BLINK_V1 */
+static int   stats         = 0;    /* query statistics instead */
+static int   status_only   = 0;    /* read the shared LED state */
+static char *state_name    = NULL; /* its name, NULL for the default */
+static machine_t *machines = NULL; /* all hosts of --machine */
+static int   nmachines     = 0;
+static int   timeout_ms    = 5000; /* per host, when fanning out */
 
-/* main - boring main routine */
+/* main - boring main routine
+
+   A single datagram is sent without blocking, a full socket buffer
+   means the command is lost.
+*/
 int
 main (int argc,
       char **argv)
 {
-  int sockfd;
+  blink_t *b;
+  int      status = EXIT_SUCCESS;
 
   /* gettext stuff */
   setlocale (LC_ALL, "");
@@ -67,32 +114,53 @@ main (int argc,
   textdomain (PACKAGE);
 
   process_opts (argc, argv);
-  server = (server == NULL)? SERV_HOST: server;
-  sockfd = connect_server ();
-  send_rate (sockfd);
-  close (sockfd);
-  return 0;
+  if (status_only)
+  {
+    return show_status ();
+  }
+  if (nmachines > 1)
+  {
+    return fan_out ();
+  }
+  if (open_flags & BLINK_DATAGRAM && !batch)
+  {
+    open_flags |= BLINK_NONBLOCK;
+  }
+  if ((b = blink_open (server, serv_tcp_port, unix_path,
+                       open_flags)) == NULL)
+  {
+    fail ("connect");
+  }
+  if (stats)
+  {
+    status = show_stats (b);
+  }
+  else if (batch)
+  {
+    status = send_batch (b);
+  }
+  else
+  {
+    send_rate (b);
+  }
+  blink_close (b);
+  return status;
 }
 
-/* connect_server - talk to blinkd server */
-static int
-connect_server (void)
+/* fail - report the error for the server or file and exit */
+static void
+fail (const char *what)
 {
-  int                sockfd;
-  struct sockaddr_in serv_addr;
-
-  if ((sockfd = socket (AF_INET, SOCK_STREAM, 0)) < 0)
+  if (unix_path != NULL)
   {
-    perror ("socket");
-    exit (EXIT_FAILURE);
+    what = unix_path;
   }
-  init_sockaddr (&serv_addr, server, serv_tcp_port);
-  if (connect (sockfd, &serv_addr, sizeof (serv_addr)) < 0)
+  else if (server != NULL)
   {
-    perror ("connect");
-    exit (EXIT_FAILURE);
+    what = server;
   }
-  return sockfd;
+  perror (what);
+  exit (EXIT_FAILURE);
 }
 
 /* process_opts - process command line, see function usage() for options */
@@ -102,10 +170,19 @@ process_opts (int argc,
 {
   int c = 0;
   struct {
+    unsigned int batch    : 1;
+    unsigned int datagram : 1;
     unsigned int led      : 1;
     unsigned int machine  : 1;
+    unsigned int machines : 1;
     unsigned int rate     : 1;
+    unsigned int ring     : 1;
+    unsigned int stats    : 1;
+    unsigned int status   : 1;
     unsigned int tcp_port : 1;
+    unsigned int timeout  : 1;
+    unsigned int local    : 1;
+    unsigned int v1       : 1;
   } flags;
 
   memset (&flags, 0, sizeof (flags));
@@ -114,23 +191,49 @@ process_opts (int argc,
     int option_index                    = 0;
     static struct option long_options[] =
     {
+      {"v1",            0, 0, '1'},
+      {"batch",         2, 0, 'b'},
       {"capslockled",   0, 0, 'c'},
+      {"datagram",      0, 0, 'd'},
       {"help",          0, 0, 'h'},
       {"machine",       1, 0, 'm'},
+      {"machines",      1, 0, 'M'},
       {"numlockled",    0, 0, 'n'},
+      {"status",        2, 0, 'q'},
       {"rate",          1, 0, 'r'},
+      {"ring",          2, 0, 'R'},
       {"scrolllockled", 0, 0, 's'},
+      {"stats",         0, 0, 'S'},
       {"tcp-port",      1, 0, 't'},
+      {"timeout",       1, 0, 'T'},
+      {"unix-socket",   1, 0, 'u'},
       {"version",       0, 0, 'v'},
       {0,               0, 0, 0}
     };
-    c = getopt_long (argc, argv, "chm:nr:st:v", long_options, &option_index);
+    c = getopt_long (argc, argv, "1b::cdhm:M:nq::r:R::sSt:T:u:v",
+                     long_options, &option_index);
     if (c == -1)
     {
       break;
     }
     switch (c)
     {
+      case '1':
+        if (flags.v1)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.v1    = 1;
+        open_flags |= BLINK_V1;
+        break;
+      case 'b':
+        if (flags.batch)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.batch = 1;
+        batch       = (optarg == NULL)? "-": optarg;
+        break;
       case 'c':
         if (flags.led)
         {
@@ -139,16 +242,28 @@ process_opts (int argc,
         led       = BLINKD_CAP;
         flags.led = 1;
         break;
+      case 'd':
+        if (flags.datagram)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.datagram = 1;
+        open_flags    |= BLINK_DATAGRAM;
+        break;
       case 'h':
         usage (argv[0]);
         exit (EXIT_SUCCESS);
       case 'm':
-        if (flags.machine)
+        flags.machine = 1;
+        add_machines (optarg);
+        break;
+      case 'M':
+        if (flags.machines)
         {
           wrong_use (argv[0]);
         }
-        flags.machine = 1;
-        server        = optarg;
+        flags.machines = 1;
+        read_machines (optarg);
         break;
       case 'n':
         if (flags.led)
@@ -166,24 +281,33 @@ process_opts (int argc,
         flags.rate = 1;
         if (!strcmp ("+", optarg))
         {
-          rate = RATE_INC;
+          delta = 1;
         }
         else if (!strcmp ("-", optarg))
         {
-          rate = RATE_DEC;
+          delta = -1;
         }
         else
         {
           rate = atoi (optarg);
-          if (rate < 0 || rate > RATE_MAX)
+          if (rate < 0 || rate > BLINKD_RATE_MAX)
           {
             fprintf (stderr,
                      _("Error.  Use value from 0 to %d for --rate.\n"),
-                     RATE_MAX);
-            rate = (rate)? RATE_MAX: 0;
+                     BLINKD_RATE_MAX);
+            rate = (rate)? BLINKD_RATE_MAX: 0;
           }
         }
         break;
+      case 'R':
+        if (flags.ring)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.ring  = 1;
+        open_flags |= BLINK_RING;
+        unix_path   = optarg;
+        break;
       case 's':
         if (flags.led)
         {
@@ -192,13 +316,50 @@ process_opts (int argc,
         led       = BLINKD_SCR;
         flags.led = 1;
         break;
+      case 'S':
+        if (flags.stats)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.stats = 1;
+        stats       = 1;
+        break;
+      case 'q':
+        if (flags.status)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.status = 1;
+        status_only  = 1;
+        state_name   = optarg;
+        break;
       case 't':
         if (flags.tcp_port)
         {
           wrong_use (argv[0]);
         }
         flags.tcp_port      = 1;
-        serv_tcp_port = atoi (optarg);
+        serv_tcp_port = atoi (optarg); /* a particular tcp server */
+        break;
+      case 'T':
+        if (flags.timeout)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.timeout = 1;
+        if ((timeout_ms = atoi (optarg)) <= 0)
+        {
+          fprintf (stderr, _("Error.  Use a positive value for --timeout.\n"));
+          exit (EXIT_FAILURE);
+        }
+        break;
+      case 'u':
+        if (flags.local)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.local = 1;
+        unix_path   = optarg;
         break;
       case 'v':
         puts (PACKAGE " " VERSION);
@@ -213,25 +374,563 @@ process_opts (int argc,
     wrong_use (argv[0]);
   }
   /* A blink rate <> 0 is only useful when specifying an LED */
-  if (flags.rate && (rate != 0) && !flags.led)
+  if (flags.rate && (rate != 0 || delta) && !flags.led)
+  {
+    wrong_use (argv[0]);
+  }
+  /* In batch mode, LEDs and rates are read from the file */
+  if (flags.batch && (flags.led || flags.rate))
+  {
+    wrong_use (argv[0]);
+  }
+  /* Statistics are a reply, that needs a connection */
+  if (flags.stats &&
+      (flags.led || flags.rate || flags.batch || flags.datagram))
   {
     wrong_use (argv[0]);
   }
+  /* The ring is on this machine and has no replies */
+  if (flags.ring &&
+      (flags.stats || flags.datagram || flags.machine || flags.machines ||
+       flags.tcp_port || flags.local))
+  {
+    wrong_use (argv[0]);
+  }
+  /* The state is read from shared memory on this machine */
+  if (flags.status &&
+      (flags.led || flags.rate || flags.batch || flags.stats ||
+       flags.datagram || flags.machine || flags.machines ||
+       flags.tcp_port || flags.local || flags.ring || flags.v1))
+  {
+    wrong_use (argv[0]);
+  }
+  /* Several machines only take a single command, over the network */
+  if (nmachines > 1 && (flags.batch || flags.stats || flags.local))
+  {
+    wrong_use (argv[0]);
+  }
+  if (flags.machines && nmachines == 0)
+  {
+    fprintf (stderr, _("%s: no machines listed\n"), argv[0]);
+    exit (EXIT_FAILURE);
+  }
+  if (nmachines == 1)
+  {
+    server = machines[0].host;
+    if (machines[0].port)
+    {
+      serv_tcp_port = machines[0].port;
+    }
+  }
+}
+
+/* split_port - cut a trailing ":port" off a host name
+
+   Returns the port, or 0 if there is none.
+*/
+static int
+split_port (char *name)
+{
+  char *colon = strrchr (name, ':');
+  char *end;
+  long  port;
+
+  if (colon == NULL || colon[1] == '\0')
+  {
+    return 0;
+  }
+  port = strtol (colon + 1, &end, 10);
+  if (*end != '\0' || port <= 0 || port > 65535)
+  {
+    return 0;
+  }
+  *colon = '\0';
+  return (int) port;
+}
+
+/* add_machines - append a comma separated list of host[:port] */
+static void
+add_machines (char *list)
+{
+  char *name;
+
+  for (name = strtok (list, ", \t"); name != NULL;
+       name = strtok (NULL, ", \t"))
+  {
+    machine_t *m;
+
+    if ((machines = realloc (machines,
+                             (nmachines + 1) * sizeof (*machines))) == NULL)
+    {
+      perror ("realloc");
+      exit (EXIT_FAILURE);
+    }
+    m = &machines[nmachines++];
+    memset (m, 0, sizeof (*m));
+    if ((m->name = strdup (name)) == NULL)
+    {
+      perror ("strdup");
+      exit (EXIT_FAILURE);
+    }
+    m->host = name;
+    m->port = split_port (name);
+  }
+}
+
+/* read_machines - add the hosts of a file, one or more per line
+
+   Anything after a '#' is a comment.  "-" is stdin.
+*/
+static void
+read_machines (const char *file)
+{
+  char  line[BATCH_BUFSIZE];
+  FILE *fp = stdin;
+
+  if (strcmp (file, "-") && (fp = fopen (file, "r")) == NULL)
+  {
+    perror (file);
+    exit (EXIT_FAILURE);
+  }
+  while (fgets (line, sizeof (line), fp) != NULL)
+  {
+    char *hash = strchr (line, '#');
+    char *copy;
+
+    if (hash != NULL)
+    {
+      *hash = '\0';
+    }
+    line[strcspn (line, "\r\n")] = '\0';
+    if ((copy = strdup (line)) == NULL)
+    {
+      perror ("strdup");
+      exit (EXIT_FAILURE);
+    }
+    add_machines (copy);
+  }
+  if (ferror (fp))
+  {
+    perror (file);
+    exit (EXIT_FAILURE);
+  }
+  if (fp != stdin)
+  {
+    fclose (fp);
+  }
+}
+
+/* fan_out - send the command to all machines at once
+
+   Names are resolved in the background by getaddrinfo_a() and every
+   connection is non-blocking, so one slow or dead host costs no more
+   than the timeout, whichever the order.  All of them share the same
+   deadline.  Prints a line per host and returns the exit status.
+*/
+static int
+fan_out (void)
+{
+  struct gaicb  **reqs;
+  struct pollfd  *fds;
+  machine_t     **polled;
+  struct timespec start;
+  int             i, type, status = EXIT_SUCCESS;
+  long            left;
+
+  reqs   = calloc (nmachines, sizeof (*reqs));
+  fds    = calloc (nmachines, sizeof (*fds));
+  polled = calloc (nmachines, sizeof (*polled));
+  if (reqs == NULL || fds == NULL || polled == NULL)
+  {
+    perror ("calloc");
+    exit (EXIT_FAILURE);
+  }
+  type = (open_flags & BLINK_DATAGRAM)? SOCK_DGRAM: SOCK_STREAM;
+  for (i = 0; i < nmachines; i++)
+  {
+    machine_t *m = &machines[i];
+
+    sprintf (m->service, "%d", m->port? m->port:
+                               serv_tcp_port? serv_tcp_port: SERV_TCP_PORT);
+    m->hints.ai_family   = AF_INET;
+    m->hints.ai_socktype = type;
+    m->req.ar_name       = m->host;
+    m->req.ar_service    = m->service;
+    m->req.ar_request    = &m->hints;
+    m->state             = HOST_RESOLVING;
+    reqs[i]              = &m->req;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  if ((i = getaddrinfo_a (GAI_NOWAIT, reqs, nmachines, NULL)))
+  {
+    fprintf (stderr, "getaddrinfo_a: %s\n", gai_strerror (i));
+    exit (EXIT_FAILURE);
+  }
+  while ((left = timeout_ms - elapsed_ms (&start)) > 0)
+  {
+    int nfds = 0, resolving = 0, busy = 0;
+
+    for (i = 0; i < nmachines; i++)
+    {
+      machine_t *m = &machines[i];
+
+      if (m->state == HOST_RESOLVING)
+      {
+        int rc = gai_error (&m->req);
+
+        if (rc == EAI_INPROGRESS)
+        {
+          resolving++;
+        }
+        else if (rc)
+        {
+          m->state = HOST_DONE;
+          m->error = (rc == EAI_SYSTEM)? strerror (errno): gai_strerror (rc);
+        }
+        else
+        {
+          machine_open (m);
+        }
+      }
+      if (m->state == HOST_SENDING)
+      {
+        busy++;
+        if ((fds[nfds].fd = blink_fd (m->b)) != -1)
+        {
+          fds[nfds].events  = blink_events (m->b);
+          fds[nfds].revents = 0;
+          polled[nfds++]    = m;
+        }
+      }
+    }
+    if (!resolving && !busy)
+    {
+      break;
+    }
+    if (resolving && left > RESOLVE_POLL)
+    {
+      left = RESOLVE_POLL;
+    }
+    if (poll (fds, nfds, (int) left) == -1 && errno != EINTR)
+    {
+      perror ("poll");
+      exit (EXIT_FAILURE);
+    }
+    for (i = 0; i < nfds; i++)
+    {
+      if (fds[i].revents)
+      {
+        machine_result (polled[i], blink_handle (polled[i]->b,
+                                                 fds[i].revents));
+      }
+    }
+  }
+  for (i = 0; i < nmachines; i++)
+  {
+    machine_t *m = &machines[i];
+
+    if (m->state == HOST_RESOLVING)
+    {
+      gai_cancel (&m->req);
+    }
+    if (m->state != HOST_DONE)
+    {
+      m->error = _("timed out");
+    }
+    if (m->error != NULL)
+    {
+      status = EXIT_FAILURE;
+    }
+    printf ("%s: %s\n", m->name, (m->error != NULL)? m->error: _("ok"));
+    if (m->b != NULL)
+    {
+      blink_close (m->b);
+    }
+  }
+  free (polled);
+  free (fds);
+  free (reqs);
+  return status;
+}
+
+/* machine_open - connect to a resolved machine and queue the command */
+static void
+machine_open (machine_t *m)
+{
+  char   addr[INET_ADDRSTRLEN];
+  struct sockaddr_in *sin;
+
+  sin = (struct sockaddr_in *) m->req.ar_result->ai_addr;
+  inet_ntop (AF_INET, &sin->sin_addr, addr, sizeof (addr));
+  freeaddrinfo (m->req.ar_result);
+  m->req.ar_result = NULL;
+  m->state         = HOST_SENDING;
+  if ((m->b = blink_open (addr, ntohs (sin->sin_port), NULL,
+                          open_flags | BLINK_NONBLOCK)) == NULL ||
+      queue_rate (m->b) == -1)
+  {
+    machine_result (m, -1);
+    return;
+  }
+  machine_result (m, blink_flush (m->b));
+}
+
+/* machine_result - note how blink_flush() or blink_handle() went */
+static void
+machine_result (machine_t *m,
+                int rc)
+{
+  if (rc == 1)
+  {
+    return;
+  }
+  m->state = HOST_DONE;
+  m->error = (rc == -1)? strerror (errno): NULL;
+}
+
+/* elapsed_ms - milliseconds since start */
+static long
+elapsed_ms (const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000L +
+         (now.tv_nsec - start->tv_nsec) / 1000000L;
+}
+
+/* queue_rate - queue the command given on the command line */
+static int
+queue_rate (blink_t *b)
+{
+  if (led == BLINKD_ALL)
+  {
+    return blink_reset (b);
+  }
+  if (delta)
+  {
+    return blink_add (b, led, delta);
+  }
+  return blink_set (b, led, rate);
 }
 
 /* send_rate - send new blink rate to the server */
 static void
-send_rate (int sockfd)
+send_rate (blink_t *b)
+{
+  if (queue_rate (b) == -1 || blink_flush (b) == -1)
+  {
+    fail ("write");
+  }
+}
+
+/* show_stats - ask the server for its statistics and print them */
+static int
+show_stats (blink_t *b)
+{
+  static char buf[STATS_BUFSIZE];
+  int         len;
+
+  if ((len = blink_stats (b, buf, sizeof (buf))) == -1)
+  {
+    perror ("read");
+    return EXIT_FAILURE;
+  }
+  fwrite (buf, 1, len, stdout);
+  return EXIT_SUCCESS;
+}
+
+/* show_status - print the LED state blinkd publishes locally
+
+   The same "name value" lines as for the statistics, rates are -1 for
+   LEDs not in use.
+*/
+static int
+show_status (void)
 {
-  unsigned char octet;
+  static const char *names[3] = { "capslock", "numlock", "scrolllock" };
+  blink_state_t     *s;
+  blink_status_t     st;
+  int                i;
 
-  octet = (led << 6);
-  octet |= rate;
-  if (write (sockfd, (const void *) &octet, 1) != 1)
+  if ((s = blink_state_open (state_name)) == NULL ||
+      blink_state_read (s, &st) == -1)
+  {
+    perror ((state_name != NULL)? state_name: "blink_state_open");
+    return EXIT_FAILURE;
+  }
+  blink_state_close (s);
+  printf ("pid %ld\n"
+          "generation %lu\n"
+          "updated %ld.%09ld\n",
+          st.pid, st.generation, (long) st.updated.tv_sec,
+          st.updated.tv_nsec);
+  for (i = BLINK_CAP; i < BLINK_ALL; i++)
   {
-    perror ("write");
+    printf ("rate_%s %d\n"
+            "lit_%s %d\n",
+            names[i], st.rate[i], names[i], (st.lit >> i) & 1);
+  }
+  printf ("on_ms %d\n"
+          "off_ms %d\n"
+          "pause_ms %d\n"
+          "channels %d\n",
+          st.on_ms, st.off_ms, st.pause_ms, st.channels);
+  return EXIT_SUCCESS;
+}
+
+/* send_batch - stream all commands of the batch file over one connection
+
+   Commands are queued as soon as a line is complete and flushed once
+   per chunk of input read, so a slow producer is never held back and
+   a fast one does not cost a write() per command.  Returns the exit
+   status.
+*/
+static int
+send_batch (blink_t *b)
+{
+  char          in[BATCH_BUFSIZE + 1];
+  size_t        inlen  = 0;
+  unsigned long lineno = 0;
+  int           fd, status = EXIT_SUCCESS, eof = 0;
+
+  if (!strcmp (batch, "-"))
+  {
+    fd = STDIN_FILENO;
+  }
+  else if ((fd = open (batch, O_RDONLY)) == -1)
+  {
+    perror (batch);
     exit (EXIT_FAILURE);
   }
+  while (!eof)
+  {
+    ssize_t rr;
+    char    *line, *nl;
+
+    if ((rr = read (fd, in + inlen, BATCH_BUFSIZE - inlen)) == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      perror ("read");
+      exit (EXIT_FAILURE);
+    }
+    if (rr == 0)                /* handle a last line without newline */
+    {
+      eof = 1;
+      if (inlen)
+      {
+        in[inlen++] = '\n';
+      }
+    }
+    inlen += rr;
+    line   = in;
+    while ((nl = memchr (line, '\n', inlen - (line - in))) != NULL)
+    {
+      *nl = '\0';
+      lineno++;
+      if (parse_command (b, line) == -1)
+      {
+        fprintf (stderr, _("%s:%lu: Invalid command.\n"), batch, lineno);
+        status = EXIT_FAILURE;
+      }
+      line = nl + 1;
+    }
+    inlen -= line - in;
+    memmove (in, line, inlen);
+    if (inlen == BATCH_BUFSIZE)
+    {
+      fprintf (stderr, _("%s:%lu: Line too long.\n"), batch, lineno + 1);
+      exit (EXIT_FAILURE);
+    }
+    if (blink_flush (b) == -1)  /* the next read() may block */
+    {
+      fail ("write");
+    }
+  }
+  if (fd != STDIN_FILENO)
+  {
+    close (fd);
+  }
+  return status;
+}
+
+/* parse_command - queue the command of one batch line "led [rate]"
+
+   led is one of "caps", "num", "scroll" or "all", rate is a number,
+   "+" or "-".  "all" resets all LEDs and takes no rate.  Returns 0,
+   also for empty and comment lines, or -1 on errors.
+*/
+static int
+parse_command (blink_t *b,
+               char *line)
+{
+  char *save, *word, *arg;
+  int   cmd_led, rc;
+
+  if ((word = strtok_r (line, " \t\r", &save)) == NULL || *word == '#')
+  {
+    return 0;
+  }
+  arg = strtok_r (NULL, " \t\r", &save);
+  if (strtok_r (NULL, " \t\r", &save) != NULL)
+  {
+    return -1;
+  }
+  if (!strcmp (word, "all"))
+  {
+    if (arg != NULL)
+    {
+      return -1;
+    }
+    if (blink_reset (b) == -1)
+    {
+      fail ("write");
+    }
+    return 0;
+  }
+  if (!strcmp (word, "caps"))
+  {
+    cmd_led = BLINKD_CAP;
+  }
+  else if (!strcmp (word, "num"))
+  {
+    cmd_led = BLINKD_NUM;
+  }
+  else if (!strcmp (word, "scroll"))
+  {
+    cmd_led = BLINKD_SCR;
+  }
+  else
+  {
+    return -1;
+  }
+  if (arg == NULL)
+  {
+    return -1;
+  }
+  if (!strcmp (arg, "+") || !strcmp (arg, "-"))
+  {
+    rc = blink_add (b, cmd_led, (*arg == '+')? 1: -1);
+  }
+  else
+  {
+    char *end;
+    long  value = strtol (arg, &end, 10);
+
+    if (*end != '\0' || value < 0 || value > BLINKD_RATE_MAX)
+    {
+      return -1;
+    }
+    rc = blink_set (b, cmd_led, (int) value);
+  }
+  if (rc == -1)                 /* the queue is full and cannot be sent */
+  {
+    fail ("write");
+  }
+  return 0;
 }
 
 /* usage - help on options */
@@ -240,15 +939,27 @@ usage (char* name)
 {
   printf (_("Usage: %s [options]\n"
             "Options are\n"
+            "  -1,   --v1            use protocol 1, for blinkd 0.4.8 and older\n"
+            "  -b,   --batch[=f]     read commands from file f (stdin)\n"
             "  -c,   --capslockled   use Caps-Lock LED\n"
+            "  -d,   --datagram      send datagrams instead of connecting\n"
             "  -h,   --help          display this help and exit\n"
-            "  -m s, --machine=s     let keyboard of machine s blink\n"
-            "  -n,   --numlockled    use Num-Lock LED\n"
-            "  -r n, --rate=n        set blink rate to n\n"
-            "  -s,   --scrolllockled use Scroll-Lock LED\n"
-            "  -t n, --tcp-port=n    use tcp port n\n"
-            "  -v,   --version       output version information and exit\n"),
+            "  -m s, --machine=s     let keyboard of machine s blink, s is a comma\n"
+            "                        separated list of host[:port], may be repeated\n"),
           name);
+  fputs (_("  -M f, --machines=f    read the machines from file f (- is stdin)\n"
+           "  -n,   --numlockled    use Num-Lock LED\n"
+           "  -q,   --status[=s]    print the LED state blinkd shares as s\n"
+           "  -r n, --rate=n        set blink rate to n\n"
+           "  -R,   --ring[=s]      push into the shared memory ring s of blinkd\n"
+           "  -s,   --scrolllockled use Scroll-Lock LED\n"
+           "  -S,   --stats         print statistics of the server\n"),
+         stdout);
+  fputs (_("  -t n, --tcp-port=n    use tcp port n\n"
+           "  -T n, --timeout=n     give up on a machine after n ms (5000)\n"
+           "  -u s, --unix-socket=s use local socket s\n"
+           "  -v,   --version       output version information and exit\n"),
+         stdout);
 }
 
 /* wrong_use - output for the user, if options cannot be interpreted */
@@ -258,22 +969,3 @@ wrong_use (char *name)
   fprintf (stderr, _("%s: Error in arguments.  Try %s --help.\n"), name, name);
   exit (EXIT_FAILURE);
 }
-
-/* init_sockaddr - initialize socket struct with hostname and port number */
-static void
-init_sockaddr (struct sockaddr_in *name,
-               const char *hostname,
-               short port)
-{
-  struct hostent *hostinfo;
-
-  name->sin_family = AF_INET;
-  name->sin_port = htons (port);
-  hostinfo = gethostbyname (hostname);
-  if (hostinfo == NULL)
-  {
-    fprintf (stderr, _("Unknown host %s.\n"), hostname);
-    exit (EXIT_FAILURE);
-  }
-  name->sin_addr = *(struct in_addr *) hostinfo->h_addr;
-}
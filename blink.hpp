@@ -0,0 +1,155 @@
+/* File: blink.hpp
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* blink.hpp - C++ wrapper of libblink.
+   A blink::connection owns a handle, errors are thrown as
+   std::system_error.  Queued commands are flushed when it goes out
+   of scope, unless it is non-blocking.  A blink::state reads the LED
+   state blinkd publishes in shared memory. */
+#ifndef BLINK_HPP
+#define BLINK_HPP
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <libblink.h>
+
+namespace blink
+{
+  class connection
+  {
+  public:
+    explicit connection (const char *host = nullptr, int port = 0,
+                         const char *path = nullptr, int flags = 0)
+      : b_ (blink_open (host, port, path, flags))
+    {
+      if (b_ == nullptr)
+      {
+        fail ("blink_open");
+      }
+    }
+    ~connection ()
+    {
+      if (b_ != nullptr)
+      {
+        blink_close (b_);
+      }
+    }
+    connection (const connection &) = delete;
+    connection &operator= (const connection &) = delete;
+    connection (connection &&other) noexcept : b_ (other.b_)
+    {
+      other.b_ = nullptr;
+    }
+
+    connection &set (blink_led_t led, int rate)
+    {
+      check (blink_set (b_, led, rate), "blink_set");
+      return *this;
+    }
+    connection &add (blink_led_t led, int delta)
+    {
+      check (blink_add (b_, led, delta), "blink_add");
+      return *this;
+    }
+    connection &reset ()
+    {
+      check (blink_reset (b_), "blink_reset");
+      return *this;
+    }
+    /* true if everything is sent */
+    bool flush ()
+    {
+      return check (blink_flush (b_), "blink_flush") == 0;
+    }
+    int fd () const
+    {
+      return blink_fd (b_);
+    }
+    int events () const
+    {
+      return blink_events (b_);
+    }
+    bool handle (int revents)
+    {
+      return check (blink_handle (b_, revents), "blink_handle") == 0;
+    }
+    std::string stats ()
+    {
+      std::string buf (65536, '\0');
+
+      buf.resize (check (blink_stats (b_, &buf[0], buf.size ()),
+                         "blink_stats"));
+      return buf;
+    }
+
+  private:
+    static void fail (const char *what)
+    {
+      throw std::system_error (errno, std::generic_category (), what);
+    }
+    static int check (int rc, const char *what)
+    {
+      if (rc == -1)
+      {
+        fail (what);
+      }
+      return rc;
+    }
+
+    blink_t *b_;
+  };
+
+  class state
+  {
+  public:
+    explicit state (const char *name = nullptr)
+      : s_ (blink_state_open (name))
+    {
+      if (s_ == nullptr)
+      {
+        throw std::system_error (errno, std::generic_category (),
+                                 "blink_state_open");
+      }
+    }
+    ~state ()
+    {
+      blink_state_close (s_);
+    }
+    state (const state &) = delete;
+    state &operator= (const state &) = delete;
+
+    blink_status_t read () const
+    {
+      blink_status_t status;
+
+      if (blink_state_read (s_, &status) == -1)
+      {
+        throw std::system_error (errno, std::generic_category (),
+                                 "blink_state_read");
+      }
+      return status;
+    }
+
+  private:
+    blink_state_t *s_;
+  };
+}
+
+#endif /* BLINK_HPP */
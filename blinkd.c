@@ -27,6 +27,7 @@
 #include <paths.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -34,8 +35,14 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <linux/kd.h>
-#include <sys/ioctl.h>
+#include <stddef.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <syslog.h>
@@ -46,48 +53,160 @@
 #include <locale.h>
 
 #include <blinkd.h>
+#include <backend.h>
+#include <pattern.h>
+#include <channel.h>
+#include <cmdq.h>
+#include <log.h>
+#include <ring.h>
+#include <state.h>
+#include <stats.h>
+#include <watch.h>
+#include <wheel.h>
 
 /* macros */
-#define KEYBOARDDEVICE	"/dev/console"
-#define SLEEPFACTOR	100000	/* tenth of a second in micro seconds */
+#define VT_ACTIVE_FILE	"/sys/class/tty/tty0/active" /* foreground tty */
 #define SYSLOGERR(str)	syslog (LOG_ERR, str " (line %d)\n", __LINE__)
 #define SYSLOGERR1(str, arg) \
 			syslog (LOG_ERR, str " (line %d)\n", arg, __LINE__)
-#define SYSLOGERR2(str, arg) \
-			syslog (LOG_ERR, str " (pid %d)\n", arg, getpid ())
+/* for the hot paths, queued and rate limited, see log.c */
+#define LOGERR(str)	log_msg (LOG_ERR, str " (line %d)", __LINE__)
+#define LOGERR1(str, arg) \
+			log_msg (LOG_ERR, str " (line %d)", arg, __LINE__)
 #define LED_UNUSED      -1
+#define LED_UNKNOWN     -1      /* led_shadow has to be read first */
+#define MAX_EVENTS      32      /* epoll events handled per wakeup */
+#define READ_BUFSIZE    512     /* octets decoded per read() */
+#define STATS_BUFSIZE   4096    /* reply to BLINKD_QUERY_STATS */
+#define DGRAM_BATCH     16      /* datagrams per recvmmsg() */
+#define RING_SIZE       1024    /* records in the command ring */
+#define RING_BATCH      256     /* records decoded per commit */
+#define LONG_BITS       (8 * (int) sizeof (unsigned long))
+#define LISTEN_FDS_START 3      /* first socket passed by systemd */
 
 /* gettext macros */
 #define _(String) gettext (String)
 
 /* type definitions */
-typedef enum {CLEAR, SET, TOGGLE} ledmode_t;
+typedef struct {
+  struct timespec accepted;     /* cleared by the first octet */
+  int             proto;        /* 0 until the first octet, 1 or 2 */
+  size_t          have;         /* octets of an incomplete v2 frame */
+  unsigned char  *frame;        /* kept for later users of the fd */
+} conn_t;
 
 /* function prototypes */
+static void accept_clients    (int listenfd);
+static void *acceptor         (void *arg);
+static void acceptors_start   (void);
+static void adopt_socket      (int fd);
+static void blinking_start    (void);
 static int  create_socket     (void);
+static int  create_udp_socket (void);
+static int  create_unix_socket (const char *path, int type);
 static void clear_led_on_exit (int sig_no);
-static void control_led       (ledmode_t mode, int led);
+static void close_leds        (void);
+static void control_leds      (int mask);
 static void daemon_start      (void);
-static void *loop             (void *led);
+static void decode_datagram   (const unsigned char *buf, size_t len);
+static void decode_frame      (int fd, const unsigned char *p,
+                               size_t size);
+static void decode_octet      (int fd, unsigned char c);
+static int  decode_stream     (int fd, conn_t *conn,
+                               const unsigned char *buf, size_t len);
+static int  command_size      (const unsigned char *p, size_t left);
+static long frame_size        (const unsigned char *p, size_t have);
+static void follow_panels     (uint64_t now);
+static int  inherit_sockets   (void);
+static void ms_to_ts          (uint64_t ms, struct timespec *ts);
+static void open_leds         (void);
+static void panels_start      (void);
 static void process_opts      (int argc, char **argv);
-static void threads_start     (void);
+static void read_client       (int fd);
+static void read_datagrams    (int fd);
+static void read_watch        (int led);
+static void *ring_reader      (void *unused);
+static void ring_start_reader (void);
+static int  read_active_vt    (void);
+static void *scheduler        (void *unused);
+static void scheduler_kick    (void);
+static void rates_changed     (void);
+static void rates_commit      (void);
+static int  rates_lit         (void);
+static void set_panel_rate    (int panel, int value, int relative);
+static void set_rate          (int led, int value, int relative);
+static void show_panel        (int c, int on);
+static void scheduler_start   (void);
+static void start_watches     (void);
+static int  parse_led         (const char *name);
+static int  parse_pattern     (char *spec);
+static int  parse_watch       (char *spec);
+static void send_reply        (int fd, const char *buf, size_t len);
+static void serve_clients     (int listenfd);
+static void signals_start     (void);
+static void send_stats        (int fd);
+static uint64_t ts_to_ms      (const struct timespec *ts);
 static void usage             (char *name);
 static void wait_for_connect  (void);
+static void watch_client      (int fd);
 static void wrong_use         (char *name);
 
 /* global variables */
-static int             keyboardDevice = 0;
+static const backend_t *backend      = &backend_console;
+static const char     *backend_arg    = NULL;
+static int             device_open    = 0;
 static int             serv_tcp_port  = SERV_TCP_PORT;
-static int             off_time       = 2;
-static int             pause_time     = 6;
+static int             off_time       = 200; /* ms */
+static int             pause_time     = 600;
 /* all three LEDs disabled */
 static int             rate[3]        = { LED_UNUSED, LED_UNUSED, LED_UNUSED };
-static int             on_time        = 2;
+static int             on_time        = 200;
 static int             leds[3]        = { LED_CAP, LED_NUM, LED_SCR };
-static pthread_t       cap_thread, num_thread, scr_thread;
-static pthread_mutex_t key_mutex;
-static int             sockfd         = 0;
+static int             managed_leds   = 0; /* mask of LEDs in use */
+static int             led_shadow     = LED_UNKNOWN; /* state of all LEDs */
+static int             leds_touched   = 0;
+static __thread conn_t *conns         = NULL; /* per client fd */
+static __thread int    conns_size     = 0;
+static __thread cmd_batch_t decoded;       /* changes not queued yet */
+static int             coalesce_ms    = 0; /* window folding changes */
+static int             npanels        = 0; /* channels after the LEDs */
+static int            *panel_rate     = NULL; /* as set by the clients */
+static unsigned long  *panel_dirty    = NULL; /* bits of changed rates */
+static __thread int    panels_decoded = 0; /* not marked by a batch yet */
+static __thread int    panels_lit     = 0; /* and one of them is not 0 */
+static const pattern_t *patterns[4]  = { NULL, NULL, NULL, NULL };
+static struct timespec epoch;              /* time 0 of the channels */
+static pthread_t       scheduler_thread;
+static int             timerfd        = -1;
+static int             kickfd         = -1;
+static int             kick_pending   = 0; /* kickfd written, not read */
+static uint64_t        kick_ns        = 0; /* first update since, or 0 */
+static int             vtfd           = -1;
+static char            active_vt[16];
+static int             sockfd         = -1;
+static int             unixfd         = -1;
+static char           *unix_path      = BLINKD_SOCKET_PATH;
+static int             udpfd          = -1;
+static int             serv_udp_port  = -1; /* -U, else the tcp port */
+static int             dgramfd        = -1;
+static int             sigfd          = -1; /* SIGTERM and SIGINT */
+static char           *dgram_path     = BLINKD_DGRAM_PATH;
+static char           *state_name     = BLINKD_STATE_NAME;
+static char           *ring_name      = ""; /* no command ring */
+static __thread int    epollfd        = -1;
+static int             listen_backlog = SOMAXCONN;
+static int             acceptors      = 1; /* threads serving tcp */
 static int             noreopen       = 0;
+static int             foreground     = 0;
+static int             inetd          = 0; /* socket from inetd on fd 0 */
+static int             blinking       = 0; /* scheduler started */
+static int             stopping       = 0; /* scheduler to clear LEDs */
+static pthread_mutex_t blinking_lock  =
+                       PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pthread_once_t  blinking_once  = PTHREAD_ONCE_INIT;
+static watch_t        *watches[3]     = { NULL, NULL, NULL };
+static char           *watch_dir[3]   = { NULL, NULL, NULL };
+static char           *watch_sep[3];  /* message name separators */
 
 /* main - does not return */
 int
@@ -100,109 +219,198 @@ main (int argc,
   textdomain (PACKAGE);
 
   process_opts (argc, argv);
-  daemon_start ();              /* start daemon */
-  sockfd = create_socket ();
-  threads_start ();             /* start 1..3 threads */
+  if (inherit_sockets ())       /* systemd or inetd keep track of us */
+  {
+    acceptors = 1;
+  }
+  else
+  {
+    if (!foreground)
+    {
+      daemon_start ();          /* start daemon */
+    }
+    sockfd = create_socket ();
+    unixfd = create_unix_socket (unix_path, SOCK_STREAM);
+    udpfd = create_udp_socket ();
+    dgramfd = create_unix_socket (dgram_path, SOCK_DGRAM);
+  }
+  signals_start ();             /* before any thread starts */
+  log_start ();                 /* start logging thread, rate limited */
+  stats_start ();
+  cmdq_start ();
+  cmdq_clear (&decoded);
+  panels_start ();
+  if (state_start (state_name, npanels, on_time, off_time,
+                   pause_time) == -1)
+  {
+    SYSLOGERR1 ("shared memory %s: %m", state_name);
+  }
+  state_publish (rate, 0);
+  start_watches ();
+  ring_start_reader ();
+  acceptors_start ();
   if (atexit ((void (*) (void)) &clear_led_on_exit))
   {
     SYSLOGERR ("atexit() error");
   }
-  signal (SIGTERM, clear_led_on_exit);
   wait_for_connect ();
   return 0;                     /* never */
 }
 
-/* clear_led_on_exit - no hanging LED after exiting blinkd, please */
+/* signals_start - take SIGTERM and SIGINT from a signalfd
+
+   clear_led_on_exit() takes locks and calls syslog(), it must not run
+   in a signal handler.  The signals are blocked in all threads, which
+   inherit the mask, and the main loop reads them instead.
+*/
+static void
+signals_start (void)
+{
+  sigset_t stop;
+
+  sigemptyset (&stop);
+  sigaddset (&stop, SIGTERM);
+  sigaddset (&stop, SIGINT);
+  if (pthread_sigmask (SIG_BLOCK, &stop, NULL) ||
+      (sigfd = signalfd (-1, &stop, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+  {
+    SYSLOGERR ("signalfd() %m");
+    exit (EXIT_FAILURE);
+  }
+}
+
+/* clear_led_on_exit - no hanging LED after exiting blinkd, please
+
+   Called at exit and for SIGTERM and SIGINT by the main loop, never
+   from a signal handler.  Once blinking, only the scheduler may touch
+   the device, so other threads hand over to it and wait for the end.
+   blinking_lock is held until _exit(), blinking cannot start any
+   more.
+*/
 static void
 clear_led_on_exit (int sig_no)
 {
   sig_no = sig_no;              /* get rid of compiler warning */
-  if (keyboardDevice)           /* clear all LEDs and close device */
+  pthread_mutex_lock (&blinking_lock);
+  __atomic_store_n (&stopping, 1, __ATOMIC_RELEASE);
+  if (__atomic_load_n (&blinking, __ATOMIC_ACQUIRE) &&
+      !pthread_equal (pthread_self (), scheduler_thread))
+  {
+    pthread_mutex_unlock (&blinking_lock);
+    scheduler_kick ();
+    pthread_join (scheduler_thread, NULL); /* never returns */
+  }
+  if (leds_touched)             /* give the LEDs back, e.g. to the keys */
   {
-    if (rate[BLINKD_CAP] != -1)
+    if (!device_open && !backend->open (backend_arg))
     {
-      control_led (CLEAR, LED_CAP);
+      device_open = 1;
     }
-    if (rate[BLINKD_NUM] != -1)
+    if (device_open && backend->release ())
     {
-      control_led (CLEAR, LED_NUM);
+      SYSLOGERR1 ("%s backend: %m", backend->name);
     }
-    if (rate[BLINKD_SCR] != -1)
+    log_msg (LOG_INFO, "%lu device calls saved by caching LED state",
+             stats_counters[STAT_IOCTLS_SAVED]);
+  }
+  if (device_open)              /* close device */
+  {
+    close_leds ();
+  }
+  if (sockfd != -1)             /* close socket */
+  {
+    close (sockfd);             /* ignore any errors */
+  }
+  if (unixfd != -1)             /* close and remove local sockets */
+  {
+    close (unixfd);             /* ignore any errors */
+    if (*unix_path && *unix_path != '@')
     {
-      control_led (CLEAR, LED_SCR);
+      unlink (unix_path);
     }
-    if (close (keyboardDevice) == -1)
+  }
+  if (dgramfd != -1)
+  {
+    close (dgramfd);            /* ignore any errors */
+    if (*dgram_path && *dgram_path != '@')
     {
-      SYSLOGERR ("close() %m");
+      unlink (dgram_path);
     }
-    keyboardDevice = 0;
   }
-  if (sockfd)                   /* close socket */
+  state_stop ();
+  ring_stop ();
+  log_flush ();
+  _exit (EXIT_SUCCESS);
+}
+
+/* close_leds - close the LED device, forget the LED state */
+static void
+close_leds (void)
+{
+  if (backend->close ())
   {
-    close (sockfd);             /* ignore any errors */
+    LOGERR1 ("%s backend: close() %m", backend->name);
   }
-  _exit (EXIT_SUCCESS);
+  device_open = 0;              /* reset for reopening and
+                                   clear_led_on_exit */
+  led_shadow  = LED_UNKNOWN;    /* next open may be on another tty */
 }
 
-/* control_led - switch LED on or off
+/* control_leds - switch the LEDs in use on or off at once
 
-   This is taken from the tleds progam, written by
-   Jouni.Lohikoski@iki.fi, any bugs in this routine are added by me.
+   mask holds the LEDs to switch on, all other LEDs in use are switched
+   off, LEDs not in use are left alone.  The state of all LEDs is kept
+   in led_shadow, so the device is only read after (re)opening it or
+   after the scheduler asked for it, and only written if anything
+   changes.  The time spent in the backend is recorded separately
+   from the time blinkd needs to get there.  This is taken from the
+   tleds progam, written by Jouni.Lohikoski@iki.fi, any bugs in this
+   routine are added by me.
 */
 static void
-control_led (ledmode_t mode,
-             int led)
+control_leds (int mask)
 {
-  char	ledVal;
-  struct {
-    int	led_mode;
-    int	led;
-  } values;
-  switch (mode)
+  struct timespec start;
+  int             ledVal;
+
+  if (!device_open)
   {
-    case SET:
-      values.led_mode = 1;
-      break;
-    case CLEAR:
-      values.led_mode = 0;
-      break;
-    case TOGGLE:
-      values.led_mode = values.led_mode? 0: 1;
+    return;
   }
-  values.led = led;
-  if (keyboardDevice && ioctl (keyboardDevice, KDGETLED, &ledVal))
+  if (led_shadow == LED_UNKNOWN)
   {
-    SYSLOGERR ("ioctl() %m");
-    if (close (keyboardDevice) == -1)
+    STATS_INC (STAT_IOCTLS);
+    if ((ledVal = backend->read ()) == -1)
     {
-      SYSLOGERR ("close() %m");
+      STATS_INC (STAT_IOCTLS_FAILED);
+      LOGERR1 ("%s backend: read %m", backend->name);
+      close_leds ();
+      return;
     }
-    keyboardDevice = 0;
+    led_shadow = ledVal;
   }
-  if (led == LED_CAP || led == LED_NUM || led == LED_SCR)
+  else
   {
-    if (mode == SET)
-    {
-      ledVal |= led;
-    }
-    else
-    {
-      ledVal &= ~led;
-    }
+    STATS_INC (STAT_IOCTLS_SAVED); /* read */
   }
-  else
+  ledVal = (led_shadow & ~managed_leds) | (mask & managed_leds);
+  if (ledVal == led_shadow)
   {
-    SYSLOGERR1 ("internal error: unknown LED: %d", led);
+    STATS_INC (STAT_IOCTLS_SAVED); /* apply */
+    return;
   }
-  if (keyboardDevice && ioctl (keyboardDevice, KDSETLED, ledVal))
+  STATS_INC (STAT_IOCTLS);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  if (backend->apply (ledVal))
   {
-    SYSLOGERR ("ioctl() %m");
-    if (close (keyboardDevice) == -1)
-    {
-      SYSLOGERR ("close() %m");
-    }
-    keyboardDevice = 0;
+    STATS_INC (STAT_IOCTLS_FAILED);
+    LOGERR1 ("%s backend: apply %m", backend->name);
+    close_leds ();
+    return;
   }
+  stats_record (HIST_DEVICE_APPLY, stats_elapsed_us (&start));
+  led_shadow   = ledVal;
+  leds_touched = 1;
 }
 
 /* create_socket - create network socket for incoming tcp connection */
@@ -210,27 +418,121 @@ static int
 create_socket (void)
 {
   struct sockaddr_in serv_addr;
+  int                fd, one = 1;
 
-  if ((sockfd = socket (AF_INET, SOCK_STREAM, 0)) < 0)
+  if ((fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    0)) < 0)
   {
     SYSLOGERR ("socket() %m");
     exit (EXIT_FAILURE);
   }
+  if (acceptors > 1 &&
+      setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof (one)) == -1)
+  {
+    SYSLOGERR ("setsockopt() %m");
+    exit (EXIT_FAILURE);
+  }
   bzero ((char *) &serv_addr, sizeof (serv_addr));
   serv_addr.sin_family      = AF_INET;
   serv_addr.sin_addr.s_addr = htonl (INADDR_ANY);
   serv_addr.sin_port        = htons (serv_tcp_port);
-  if (bind (sockfd, &serv_addr, sizeof (serv_addr)) == -1)
+  if (bind (fd, &serv_addr, sizeof (serv_addr)) == -1)
   {
     SYSLOGERR ("bind() %m");
     exit (EXIT_FAILURE);
   }
-  if (listen (sockfd, 5) == -1)
+  if (listen (fd, listen_backlog) == -1)
   {
     SYSLOGERR ("listen() %m");
     exit (EXIT_FAILURE);
   }
-  return sockfd;
+  return fd;
+}
+
+/* create_udp_socket - create network socket for incoming datagrams
+
+   Port 0 disables it.  Failure is not fatal, as clients can still use
+   tcp.
+*/
+static int
+create_udp_socket (void)
+{
+  struct sockaddr_in serv_addr;
+  int                fd;
+
+  if (!serv_udp_port)
+  {
+    return -1;
+  }
+  if ((fd = socket (AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    0)) < 0)
+  {
+    SYSLOGERR ("socket() %m");
+    return -1;
+  }
+  memset (&serv_addr, 0, sizeof (serv_addr));
+  serv_addr.sin_family      = AF_INET;
+  serv_addr.sin_addr.s_addr = htonl (INADDR_ANY);
+  serv_addr.sin_port        = htons (serv_udp_port);
+  if (bind (fd, (struct sockaddr *) &serv_addr, sizeof (serv_addr)) == -1)
+  {
+    SYSLOGERR ("bind() %m");
+    close (fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* create_unix_socket - create local socket for clients on this machine
+
+   type is SOCK_STREAM or SOCK_DGRAM.  A name starting with "@" is
+   bound in the abstract namespace, an empty name disables the local
+   socket.  Failure is not fatal, as clients can still use tcp.
+*/
+static int
+create_unix_socket (const char *path,
+                    int type)
+{
+  struct sockaddr_un addr;
+  socklen_t          addrlen;
+  size_t             len = strlen (path);
+  int                fd;
+
+  if (!len)
+  {
+    return -1;
+  }
+  if (len >= sizeof (addr.sun_path))
+  {
+    SYSLOGERR1 ("socket name %s too long", path);
+    return -1;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  memcpy (addr.sun_path, path, len);
+  addrlen = offsetof (struct sockaddr_un, sun_path) + len;
+  if (*path == '@')
+  {
+    addr.sun_path[0] = '\0';
+  }
+  else
+  {
+    addrlen++;
+    unlink (path);              /* stale from a crash, tcp bind worked */
+  }
+  if ((fd = socket (AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+  {
+    SYSLOGERR ("socket() %m");
+    return -1;
+  }
+  if (bind (fd, (struct sockaddr *) &addr, addrlen) == -1 ||
+      (type == SOCK_STREAM && listen (fd, listen_backlog) == -1))
+  {
+    SYSLOGERR1 ("bind() on %s %m", path);
+    close (fd);
+    return -1;
+  }
+  return fd;
 }
 
 /* daemon_start - become process group leader, disconnect from tty etc. */
@@ -252,173 +554,1349 @@ daemon_start (void)
        This guarantees the 1st child not to be a process leader. */
     if ((childpid = fork ()) < 0)
     {
-      perror ("fork");
-      exit (EXIT_FAILURE);
+      perror ("fork");
+      exit (EXIT_FAILURE);
+    }
+    else if (childpid > 0)
+    {
+      exit (EXIT_SUCCESS);      /* parent */
+    }
+
+    /* The 1st child disassociates from controlling terminal and
+       process group. */
+    if (setpgrp () == -1)
+    {
+      perror ("setpgrp");
+      exit (EXIT_FAILURE);
+    }
+    signal (SIGHUP, SIG_IGN);
+    if ((childpid = fork ()) < 0)
+    {
+      perror ("fork");
+      exit (EXIT_FAILURE);
+    }
+    else if (childpid > 0)
+    {
+      exit (EXIT_SUCCESS);      /* parent */
+    }
+  }
+
+  for (fd = 0; fd <= STDERR_FILENO; fd++)
+  {
+    if (close (fd) == -1)
+    {
+      SYSLOGERR ("close() %m");
+    }
+  }
+  if (chdir ("/tmp") == -1)
+  {
+    SYSLOGERR ("chdir() %m");
+  }
+  umask (0);
+}
+
+/* wait_for_connect - endless loop, wait for tcp connections and update data
+
+   Client connections are kept open until the client closes them, so
+   one connection may carry any number of command octets.  Clients
+   sending a single octet and closing work just like before.
+*/
+static void
+wait_for_connect (void)
+{
+  struct epoll_event ev;
+  int                i;
+
+  if ((epollfd = epoll_create1 (EPOLL_CLOEXEC)) == -1)
+  {
+    SYSLOGERR ("epoll_create1() %m");
+    exit (EXIT_FAILURE);
+  }
+  memset (&ev, 0, sizeof (ev));
+  ev.events  = EPOLLIN;
+  ev.data.fd = sockfd;
+  if (sockfd != -1 && epoll_ctl (epollfd, EPOLL_CTL_ADD, sockfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  ev.events  = EPOLLIN | ((acceptors > 1)? EPOLLEXCLUSIVE: 0);
+  ev.data.fd = unixfd;
+  if (unixfd != -1 && epoll_ctl (epollfd, EPOLL_CTL_ADD, unixfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  ev.events  = EPOLLIN;
+  ev.data.fd = udpfd;
+  if (udpfd != -1 && epoll_ctl (epollfd, EPOLL_CTL_ADD, udpfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  ev.data.fd = dgramfd;
+  if (dgramfd != -1 &&
+      epoll_ctl (epollfd, EPOLL_CTL_ADD, dgramfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  ev.data.fd = sigfd;
+  if (epoll_ctl (epollfd, EPOLL_CTL_ADD, sigfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    if (watches[i] == NULL)
+    {
+      continue;
+    }
+    ev.data.fd = watch_fd (watches[i]);
+    if (epoll_ctl (epollfd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1)
+    {
+      SYSLOGERR ("epoll_ctl() %m");
+      exit (EXIT_FAILURE);
+    }
+    set_rate (i, watch_count (watches[i]), 0);
+  }
+  serve_clients (sockfd);
+}
+
+/* inherit_sockets - take over the sockets passed by systemd or inetd
+
+   systemd sets LISTEN_PID to our pid and passes LISTEN_FDS sockets
+   from fd 3 on, inetd passes one on fd 0.  Returns 1 if there are
+   any, blinkd then serves only those and stays in the foreground.
+*/
+static int
+inherit_sockets (void)
+{
+  const char *pid = getenv ("LISTEN_PID");
+  const char *fds = getenv ("LISTEN_FDS");
+  int         fd, n;
+
+  if (inetd)
+  {
+    adopt_socket (STDIN_FILENO);
+    return 1;
+  }
+  if (pid == NULL || fds == NULL || atol (pid) != (long) getpid () ||
+      (n = atoi (fds)) < 1)
+  {
+    return 0;
+  }
+  unsetenv ("LISTEN_PID");      /* not for our children */
+  unsetenv ("LISTEN_FDS");
+  unsetenv ("LISTEN_FDNAMES");
+  for (fd = LISTEN_FDS_START; fd < LISTEN_FDS_START + n; fd++)
+  {
+    adopt_socket (fd);
+  }
+  return 1;
+}
+
+/* adopt_socket - serve an inherited socket as the one of its kind
+
+   A connected stream socket, from inetd nowait, is refused: a blinkd
+   per connection could not stop the LEDs the one before set blinking.
+   Inherited local sockets are not removed on exit, they belong to
+   whoever created them.
+*/
+static void
+adopt_socket (int fd)
+{
+  struct sockaddr_storage addr;
+  socklen_t               addrlen = sizeof (addr);
+  socklen_t               len     = sizeof (int);
+  int                     type, listening = 0, *kind;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_TYPE, &type, &len) == -1 ||
+      getsockname (fd, (struct sockaddr *) &addr, &addrlen) == -1 ||
+      (type == SOCK_STREAM &&
+       getsockopt (fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == -1))
+  {
+    SYSLOGERR1 ("inherited fd %d: %m", fd);
+    exit (EXIT_FAILURE);
+  }
+  if (fcntl (fd, F_SETFD, FD_CLOEXEC) == -1 ||
+      fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) == -1)
+  {
+    SYSLOGERR1 ("inherited fd %d: fcntl() %m", fd);
+    exit (EXIT_FAILURE);
+  }
+  if (type == SOCK_STREAM && !listening)
+  {
+    SYSLOGERR1 ("inherited fd %d: a connection, use inetd wait", fd);
+    exit (EXIT_FAILURE);
+  }
+  if (type == SOCK_STREAM)
+  {
+    kind = (addr.ss_family == AF_UNIX)? &unixfd: &sockfd;
+    unix_path = (addr.ss_family == AF_UNIX)? "": unix_path;
+  }
+  else
+  {
+    kind = (addr.ss_family == AF_UNIX)? &dgramfd: &udpfd;
+    dgram_path = (addr.ss_family == AF_UNIX)? "": dgram_path;
+  }
+  if (*kind != -1)
+  {
+    SYSLOGERR1 ("inherited fd %d: one socket of a kind only", fd);
+    close (fd);
+    return;
+  }
+  *kind = fd;
+}
+
+/* serve_clients - the loop of the main thread and the acceptors
+
+   Only the main thread watches the datagram sockets and spools, the
+   acceptors serve the connections they accepted themselves.
+*/
+static void
+serve_clients (int listenfd)
+{
+  struct epoll_event events[MAX_EVENTS];
+  int                i;
+
+  /* The main loop, changes decoded in one pass are queued together */
+  while (1)
+  {
+    int nfds;
+
+    rates_commit ();
+    if ((nfds = epoll_wait (epollfd, events, MAX_EVENTS,
+                            cmdq_empty (&decoded)? -1: 1)) == -1)
+    {
+      if (errno != EINTR)
+      {
+        SYSLOGERR ("epoll_wait() %m");
+        exit (EXIT_FAILURE);
+      }
+      continue;
+    }
+    for (i = 0; i < nfds; i++)
+    {
+      if (events[i].data.fd == listenfd || events[i].data.fd == unixfd)
+      {
+        accept_clients (events[i].data.fd);
+      }
+      else if (events[i].data.fd == udpfd || events[i].data.fd == dgramfd)
+      {
+        read_datagrams (events[i].data.fd);
+      }
+      else if (events[i].data.fd == sigfd)
+      {
+        clear_led_on_exit (0);  /* SIGTERM or SIGINT */
+      }
+      else if (watches[BLINKD_CAP] != NULL &&
+               events[i].data.fd == watch_fd (watches[BLINKD_CAP]))
+      {
+        read_watch (BLINKD_CAP);
+      }
+      else if (watches[BLINKD_NUM] != NULL &&
+               events[i].data.fd == watch_fd (watches[BLINKD_NUM]))
+      {
+        read_watch (BLINKD_NUM);
+      }
+      else if (watches[BLINKD_SCR] != NULL &&
+               events[i].data.fd == watch_fd (watches[BLINKD_SCR]))
+      {
+        read_watch (BLINKD_SCR);
+      }
+      else
+      {
+        read_client (events[i].data.fd);
+      }
+    }
+  }
+}
+
+/* acceptors_start - start the threads accepting tcp connections
+
+   With more than one acceptor, every thread has its own tcp socket
+   bound with SO_REUSEPORT, the kernel spreads new connections among
+   them.  The local socket is shared, each connection wakes only one
+   of them.  The main thread is the first acceptor.
+*/
+static void
+acceptors_start (void)
+{
+  pthread_t thread;
+  int       i;
+
+  for (i = 1; i < acceptors; i++)
+  {
+    if (pthread_create (&thread, NULL, &acceptor,
+                        (void *) (long) create_socket ()))
+    {
+      SYSLOGERR ("pthread_create");
+      exit (EXIT_FAILURE);
+    }
+    pthread_detach (thread);
+  }
+}
+
+/* acceptor - thread serving the connections of one tcp socket */
+static void *
+acceptor (void *arg)
+{
+  struct epoll_event ev;
+  int                listenfd = (int) (long) arg;
+
+  cmdq_clear (&decoded);
+  if ((epollfd = epoll_create1 (EPOLL_CLOEXEC)) == -1)
+  {
+    SYSLOGERR ("epoll_create1() %m");
+    exit (EXIT_FAILURE);
+  }
+  memset (&ev, 0, sizeof (ev));
+  ev.events  = EPOLLIN;
+  ev.data.fd = listenfd;
+  if (epoll_ctl (epollfd, EPOLL_CTL_ADD, listenfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  ev.events  = EPOLLIN | EPOLLEXCLUSIVE;
+  ev.data.fd = unixfd;
+  if (unixfd != -1 && epoll_ctl (epollfd, EPOLL_CTL_ADD, unixfd, &ev) == -1)
+  {
+    SYSLOGERR ("epoll_ctl() %m");
+    exit (EXIT_FAILURE);
+  }
+  serve_clients (listenfd);
+  return NULL;                  /* never reached */
+}
+
+/* accept_clients - accept all pending connections and watch them */
+static void
+accept_clients (int listenfd)
+{
+  int newsockfd;
+
+  while ((newsockfd = accept4 (listenfd, NULL, NULL,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+  {
+    STATS_INC (STAT_CONNECTIONS);
+    watch_client (newsockfd);
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+      errno != ECONNABORTED)
+  {
+    LOGERR ("accept() %m");
+  }
+}
+
+/* read_client - decode whatever a client has sent, close on end of file
+
+   Only one read() per wakeup, so a busy client cannot starve the
+   others; epoll reports the descriptor again if data is left.
+*/
+static void
+read_client (int fd)
+{
+  unsigned char buf[READ_BUFSIZE];
+  ssize_t       rr;
+
+  if ((rr = read (fd, buf, sizeof (buf))) > 0)
+  {
+    conn_t *conn = &conns[fd];
+    ssize_t i;
+
+    STATS_ADD (STAT_OCTETS, rr);
+    if (!conn->proto)           /* the first octet tells the protocol */
+    {
+      stats_record (HIST_ACCEPT_DECODE, stats_elapsed_us (&conn->accepted));
+      conn->proto = (buf[0] == BLINKD_V2)? 2: 1;
+    }
+    if (conn->proto == 1)
+    {
+      for (i = 0; i < rr; i++)
+      {
+        decode_octet (fd, buf[i]);
+      }
+      return;
+    }
+    if (!decode_stream (fd, conn, buf, rr))
+    {
+      return;
+    }
+  }
+  else if (rr == -1)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+    {
+      return;
+    }
+    LOGERR ("read() %m");
+  }
+  if (close (fd) == -1)         /* also removes fd from the epoll set */
+  {
+    LOGERR ("close() %m");
+  }
+}
+
+/* watch_client - start decoding what a new connection sends */
+static void
+watch_client (int fd)
+{
+  struct epoll_event ev;
+
+  if (fd >= conns_size)
+  {
+    int     size = (fd + 64) & ~63;
+    conn_t *grown;
+
+    if ((grown = realloc (conns, size * sizeof (*grown))) == NULL)
+    {
+      LOGERR ("realloc() %m");
+      close (fd);               /* ignore any errors */
+      return;
+    }
+    memset (grown + conns_size, 0, (size - conns_size) * sizeof (*grown));
+    conns      = grown;
+    conns_size = size;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &conns[fd].accepted);
+  conns[fd].proto = 0;
+  conns[fd].have  = 0;
+  memset (&ev, 0, sizeof (ev));
+  ev.events  = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl (epollfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+  {
+    LOGERR ("epoll_ctl() %m");
+    close (fd);                 /* ignore any errors */
+  }
+}
+
+/* read_datagrams - decode a batch of datagrams with one recvmmsg()
+
+   Every datagram may carry up to BLINKD_DGRAM_MAX command octets.  As
+   with stream clients, only one batch is taken per wakeup.
+*/
+static void
+read_datagrams (int fd)
+{
+  unsigned char  bufs[DGRAM_BATCH][BLINKD_DGRAM_MAX];
+  struct iovec   iov[DGRAM_BATCH];
+  struct mmsghdr msgs[DGRAM_BATCH];
+  int            i, n;
+
+  memset (msgs, 0, sizeof (msgs));
+  for (i = 0; i < DGRAM_BATCH; i++)
+  {
+    iov[i].iov_base            = bufs[i];
+    iov[i].iov_len             = sizeof (bufs[i]);
+    msgs[i].msg_hdr.msg_iov    = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  if ((n = recvmmsg (fd, msgs, DGRAM_BATCH, MSG_DONTWAIT, NULL)) == -1)
+  {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+      LOGERR ("recvmmsg() %m");
+    }
+    return;
+  }
+  STATS_ADD (STAT_DATAGRAMS, n);
+  for (i = 0; i < n; i++)
+  {
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+    {
+      LOGERR1 ("datagram longer than %d octets truncated",
+               BLINKD_DGRAM_MAX);
+    }
+    decode_datagram (bufs[i], msgs[i].msg_len);
+  }
+}
+
+/* decode_datagram - decode command octets or v2 frames without replies
+
+   Used for datagrams and for the records of the command ring.
+*/
+static void
+decode_datagram (const unsigned char *buf,
+                 size_t len)
+{
+  size_t j;
+
+  STATS_ADD (STAT_OCTETS, len);
+  if (len && buf[0] == BLINKD_V2)
+  {
+    long size;
+
+    for (j = 0;
+         (size = frame_size (buf + j, len - j)) > 0 &&
+           size <= (long) (len - j);
+         j += size)
+    {
+      decode_frame (-1, buf + j, size);
+    }
+    if (j < len)
+    {
+      STATS_INC (STAT_INVALID);
+      LOGERR ("bad frame in datagram");
+    }
+    return;
+  }
+  for (j = 0; j < len; j++)
+  {
+    decode_octet (-1, buf[j]);
+  }
+}
+
+/* ring_reader - thread decoding the records of the command ring
+
+   Records are decoded like datagrams and committed once per batch.
+   It sleeps while the ring is empty, but only for a moment if the
+   scheduler's queue was full and changes are still waiting.
+*/
+static void *
+ring_reader (void *unused)
+{
+  static const struct timespec retry = { 0, 1000000 };
+  unsigned char                buf[BLINKD_RING_DATA];
+  int                          len, n, rc;
+
+  cmdq_clear (&decoded);
+  while (1)
+  {
+    for (n = 0; n < RING_BATCH && (len = ring_pop (buf)) != -1; n++)
+    {
+      decode_datagram (buf, len);
+    }
+    STATS_ADD (STAT_RING_RECORDS, n);
+    rates_commit ();
+    if (n == RING_BATCH)
+    {
+      continue;
+    }
+    rc = ring_wait ((cmdq_empty (&decoded) && !panels_decoded)? NULL:
+                    &retry);
+    if (rc == -1)
+    {
+      LOGERR ("futex() %m");
+    }
+    else if (rc == 1)
+    {
+      STATS_INC (STAT_RING_WAKEUPS);
+    }
+  }
+  return unused;                /* never reached */
+}
+
+/* ring_start_reader - create the command ring and its thread
+
+   Pushing into the ring is allowed to those who may connect to the
+   local socket: the classes with write access to it get read and
+   write access to the ring, with the group of the socket.  Everybody
+   may connect to an abstract socket, without a socket in the file
+   system only the owner may push.
+*/
+static void
+ring_start_reader (void)
+{
+  pthread_t   thread;
+  struct stat st;
+  mode_t      mode = S_IRUSR | S_IWUSR;
+  gid_t       gid  = (gid_t) -1;
+
+  if (!*ring_name)
+  {
+    return;
+  }
+  if (unixfd != -1 && *unix_path == '@')
+  {
+    mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+  }
+  else if (unixfd != -1 && *unix_path && stat (unix_path, &st) == 0)
+  {
+    mode |= (st.st_mode & S_IWGRP)? S_IRGRP | S_IWGRP: 0;
+    mode |= (st.st_mode & S_IWOTH)? S_IROTH | S_IWOTH: 0;
+    gid   = st.st_gid;
+  }
+  if (ring_start (ring_name, RING_SIZE, mode, gid) == -1)
+  {
+    SYSLOGERR1 ("shared memory %s: %m", ring_name);
+    return;
+  }
+  if (pthread_create (&thread, NULL, &ring_reader, NULL))
+  {
+    SYSLOGERR ("pthread_create");
+    exit (EXIT_FAILURE);
+  }
+}
+
+/* read_watch - let an LED blink as often as its spool has messages */
+static void
+read_watch (int led)
+{
+  if (watch_read (watches[led]) == -1)
+  {
+    LOGERR1 ("watching %s %m", watch_dir[led]);
+  }
+  log_msg (LOG_DEBUG, "%d messages in %s", watch_count (watches[led]),
+           watch_dir[led]);
+  set_rate (led, watch_count (watches[led]), 0);
+}
+
+/* decode_stream - collect v2 frames from a connection and decode them
+
+   Incomplete frames are kept until the rest arrives.  Returns -1 if
+   the connection has to be closed, after a bad header there is no way
+   to find the next frame.
+*/
+static int
+decode_stream (int fd,
+               conn_t *conn,
+               const unsigned char *buf,
+               size_t len)
+{
+  if (conn->frame == NULL &&
+      (conn->frame = malloc (BLINKD_HDR_SIZE + BLINKD_FRAME_MAX)) == NULL)
+  {
+    LOGERR ("malloc() %m");
+    return -1;
+  }
+  while (len)
+  {
+    size_t n = BLINKD_HDR_SIZE + BLINKD_FRAME_MAX - conn->have;
+    size_t off;
+    long   size;
+
+    if (n > len)
+    {
+      n = len;
+    }
+    memcpy (conn->frame + conn->have, buf, n);
+    conn->have += n;
+    buf        += n;
+    len        -= n;
+    for (off = 0;
+         (size = frame_size (conn->frame + off, conn->have - off)) > 0 &&
+           size <= (long) (conn->have - off);
+         off += size)
+    {
+      decode_frame (fd, conn->frame + off, size);
+    }
+    if (size == -1)
+    {
+      STATS_INC (STAT_INVALID);
+      LOGERR ("bad frame header, closing connection");
+      return -1;
+    }
+    memmove (conn->frame, conn->frame + off, conn->have - off);
+    conn->have -= off;
+  }
+  return 0;
+}
+
+/* frame_size - size of the frame starting at p
+
+   Returns 0 if the header is not complete yet, -1 if it is bad.
+*/
+static long
+frame_size (const unsigned char *p,
+            size_t have)
+{
+  long len;
+
+  if (have < BLINKD_HDR_SIZE)
+  {
+    return 0;
+  }
+  len = (p[2] << 8) | p[3];
+  if (p[0] != BLINKD_V2 || len > BLINKD_FRAME_MAX)
+  {
+    return -1;
+  }
+  return BLINKD_HDR_SIZE + len;
+}
+
+/* command_size - size of the v2 command at p, 0 if it is bad */
+static int
+command_size (const unsigned char *p,
+              size_t left)
+{
+  switch (*p)
+  {
+    case BLINKD_OP_SET:
+    case BLINKD_OP_ADD:
+      return (left >= 4 && p[1] <= BLINKD_ALL)? 4: 0;
+    case BLINKD_OP_RESET:
+      return 1;
+    case BLINKD_OP_QUERY:
+      return (left >= 2 && p[1] <= BLINKD_Q_STATS)? 2: 0;
+    case BLINKD_OP_SET_CH:
+    case BLINKD_OP_ADD_CH:
+      return (left >= 5 &&
+              ((p[1] << 8) | p[2]) < CHANNEL_LEDS + npanels)? 5: 0;
+    default:
+      return 0;
+  }
+}
+
+/* decode_frame - apply all commands of a v2 frame at once, reply
+
+   The frame is checked completely before anything is applied.  The
+   scheduler sees either none or all of its changes.  Queried rates
+   include the changes of the frame so far.
+*/
+static void
+decode_frame (int fd,
+              const unsigned char *p,
+              size_t size)
+{
+  unsigned char        reply[BLINKD_HDR_SIZE + BLINKD_FRAME_MAX];
+  const unsigned char *end     = p + size;
+  const unsigned char *cmds;
+  size_t               n       = BLINKD_HDR_SIZE + 3;
+  int                  flags   = p[1];
+  int                  queries = 0;
+  int                  len;
+
+  memset (reply, 0, n);
+  p += BLINKD_HDR_SIZE;
+  if (flags & BLINKD_F_ACK && end - p >= 2)
+  {
+    reply[BLINKD_HDR_SIZE]     = *p++;
+    reply[BLINKD_HDR_SIZE + 1] = *p++;
+  }
+  else if (flags & BLINKD_F_ACK)
+  {
+    p = NULL;                   /* no id, no reply either */
+    flags &= ~BLINKD_F_ACK;
+  }
+  for (cmds = p; p != NULL && p < end && (len = command_size (p, end - p));
+       p += len)
+  {
+    queries += (*p == BLINKD_OP_QUERY);
+  }
+  STATS_INC (STAT_FRAMES);
+  if (p == NULL || p < end)
+  {
+    STATS_INC (STAT_INVALID);
+    log_msg (LOG_WARNING, "Received invalid frame");
+    reply[BLINKD_HDR_SIZE + 2] = BLINKD_EBADCMD;
+    queries = 0;
+  }
+  else
+  {
+    for (p = cmds; p < end; p += command_size (p, end - p))
+    {
+      int led   = p[1];
+      int value = (p[2] << 8) | p[3];
+      int i;
+
+      switch (*p)
+      {
+        case BLINKD_OP_ADD:
+          if (value & 0x8000)   /* signed */
+          {
+            value -= 0x10000;
+          }
+          /* fall through */
+        case BLINKD_OP_SET:
+          for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+          {
+            if (led == i || led == BLINKD_ALL)
+            {
+              set_rate (i, value, *p == BLINKD_OP_ADD);
+            }
+          }
+          break;
+        case BLINKD_OP_ADD_CH:
+        case BLINKD_OP_SET_CH:
+          led   = (p[1] << 8) | p[2];
+          value = (p[3] << 8) | p[4];
+          if (*p == BLINKD_OP_ADD_CH && value & 0x8000)
+          {
+            value -= 0x10000;
+          }
+          if (led < CHANNEL_LEDS)
+          {
+            set_rate (led, value, *p == BLINKD_OP_ADD_CH);
+          }
+          else
+          {
+            set_panel_rate (led - CHANNEL_LEDS, value,
+                            *p == BLINKD_OP_ADD_CH);
+          }
+          break;
+        case BLINKD_OP_RESET:
+          for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+          {
+            set_rate (i, 0, 0);
+          }
+          for (i = 0; i < npanels; i++)
+          {
+            set_panel_rate (i, 0, 0);
+          }
+          break;
+        case BLINKD_OP_QUERY:
+          if (led == BLINKD_Q_RATES && n + 6 <= sizeof (reply))
+          {
+            for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+            {
+              int r = __atomic_load_n (&rate[i], __ATOMIC_RELAXED);
+
+              r = (r == LED_UNUSED)? BLINKD_RATE_NONE:
+                                     cmdq_apply (&decoded, i, r);
+              reply[n++] = r >> 8;
+              reply[n++] = r & 0xff;
+            }
+          }
+          else if (led == BLINKD_Q_STATS && n + 2 < sizeof (reply))
+          {
+            size_t text = stats_format ((char *) reply + n + 2,
+                                        sizeof (reply) - n - 2);
+
+            reply[n++] = text >> 8;
+            reply[n++] = text & 0xff;
+            n += text;
+          }
+          break;
+      }
+    }
+  }
+  if (fd != -1 && (flags & BLINKD_F_ACK || queries))
+  {
+    reply[0] = BLINKD_V2;
+    reply[1] = BLINKD_F_REPLY | (flags & BLINKD_F_ACK);
+    reply[2] = (n - BLINKD_HDR_SIZE) >> 8;
+    reply[3] = (n - BLINKD_HDR_SIZE) & 0xff;
+    send_reply (fd, (const char *) reply, n);
+  }
+}
+
+/* decode_octet - update blink rates according to one command octet
+
+   Replies to requests go to fd, there are none for datagrams (-1).
+*/
+static void
+decode_octet (int fd,
+              unsigned char c)
+{
+  int  current_led = (c >> 6) & 0x03;
+  char new_rate    = c        & 0x1f;
+
+  if (c & BLINKD_REQUEST)
+  {
+    if (c == BLINKD_QUERY_STATS && fd != -1)
+    {
+      send_stats (fd);
+      return;
+    }
+    if (c == BLINKD_PING && fd != -1)
+    {
+      send_reply (fd, "\n", 1);
+      return;
+    }
+    STATS_INC (STAT_INVALID);
+    log_msg (LOG_WARNING, "Received inappropriate blink rate 0x%0x", c);
+    return;
+  }
+  log_msg (LOG_DEBUG, "Received blink rate 0x%0x, led %d, rate %d",
+           c, current_led, new_rate);
+  if (current_led != BLINKD_ALL)
+  {
+    if (new_rate == RATE_INC || new_rate == RATE_DEC)
+    {
+      set_rate (current_led, (new_rate == RATE_INC)? 1: -1, 1);
+    }
+    else
+    {
+      set_rate (current_led, new_rate, 0);
+    }
+  }
+  else                          /* resetting all LEDs at once */
+  {
+    set_rate (BLINKD_CAP, 0, 0);
+    set_rate (BLINKD_NUM, 0, 0);
+    set_rate (BLINKD_SCR, 0, 0);
+  }
+}
+
+/* send_reply - reply to a request
+
+   Replies are small enough for the socket buffer, a client not
+   reading them gets them truncated rather than blocking blinkd.
+*/
+static void
+send_reply (int fd,
+            const char *buf,
+            size_t len)
+{
+  if (send (fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t) len)
+  {
+    LOGERR ("send() %m");
+  }
+}
+
+/* send_stats - reply to BLINKD_QUERY_STATS */
+static void
+send_stats (int fd)
+{
+  char buf[STATS_BUFSIZE];
+
+  send_reply (fd, buf, stats_format (buf, sizeof (buf)));
+}
+
+/* set_rate - add a new rate for an LED to the decoded changes
+
+   With relative set, value is added to the rate.  Rates stay between 0
+   and BLINKD_RATE_MAX, LEDs not in use are left alone.  The changes
+   reach the scheduler only with rates_commit().
+*/
+static void
+set_rate (int led,
+          int value,
+          int relative)
+{
+  if (__atomic_load_n (&rate[led], __ATOMIC_RELAXED) == LED_UNUSED)
+  {
+    return;
+  }
+  if (relative)
+  {
+    cmdq_add (&decoded, led, value);
+  }
+  else
+  {
+    cmdq_set (&decoded, led, value);
+  }
+}
+
+/* set_panel_rate - set a new rate for a panel LED
+
+   There are too many panel LEDs for the batches, their rates are
+   changed in place and marked for the scheduler, which follows them
+   with the next batch.  Rates stay between 0 and BLINKD_RATE_MAX.
+*/
+static void
+set_panel_rate (int panel,
+                int value,
+                int relative)
+{
+  int old = __atomic_load_n (&panel_rate[panel], __ATOMIC_RELAXED);
+  int new_rate;
+
+  do
+  {
+    new_rate = relative? old + value: value;
+    new_rate = (new_rate < 0)? 0:
+               (new_rate > BLINKD_RATE_MAX)? BLINKD_RATE_MAX: new_rate;
+  }
+  while (!__atomic_compare_exchange_n (&panel_rate[panel], &old, new_rate,
+                                       1, __ATOMIC_RELAXED,
+                                       __ATOMIC_RELAXED));
+  __atomic_fetch_or (&panel_dirty[panel / LONG_BITS],
+                     1UL << (panel % LONG_BITS), __ATOMIC_RELEASE);
+  panels_decoded = 1;
+  panels_lit    |= (new_rate != 0);
+}
+
+/* rates_commit - queue the decoded changes for the scheduler
+
+   They are folded into one change, whatever the number of commands.
+   If the queue is full, they are kept and later changes are folded
+   in, until the scheduler has made room.  Changed panel LEDs are
+   announced with a batch too, even an empty one.  The first changes
+   letting anything blink start the scheduler, changes before that
+   only leave all rates at 0 and are dropped.
+*/
+static void
+rates_commit (void)
+{
+  if (cmdq_empty (&decoded) && !panels_decoded)
+  {
+    return;
+  }
+  if (!__atomic_load_n (&blinking, __ATOMIC_ACQUIRE))
+  {
+    if (!rates_lit ())
+    {
+      cmdq_clear (&decoded);
+      panels_decoded = 0;
+      return;
+    }
+    pthread_once (&blinking_once, blinking_start);
+  }
+  if (cmdq_push (&decoded) == -1)
+  {
+    STATS_INC (STAT_QUEUE_FULL);
+  }
+  else
+  {
+    STATS_INC (STAT_BATCHES);
+    cmdq_clear (&decoded);
+    panels_decoded = 0;
+    panels_lit     = 0;
+  }
+  rates_changed ();
+}
+
+/* rates_lit - would the decoded changes let an LED blink, with all
+   rates still at 0? */
+static int
+rates_lit (void)
+{
+  int i;
+
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    if (rate[i] != LED_UNUSED && cmdq_apply (&decoded, i, 0) > 0)
+    {
+      return 1;
+    }
+  }
+  return panels_lit;
+}
+
+/* blinking_start - everything only needed once LEDs blink
+
+   Started once by the first rate other than 0, so an idle blinkd has
+   no scheduler and no device open.  The device is opened right away if
+   it is kept open anyway.  Not once clear_led_on_exit() began.
+*/
+static void
+blinking_start (void)
+{
+  pthread_mutex_lock (&blinking_lock);
+  if (!__atomic_load_n (&stopping, __ATOMIC_ACQUIRE))
+  {
+    if (!(backend->flags & BACKEND_VT))
+    {
+      open_leds ();
+    }
+    scheduler_start ();         /* start the blinking thread */
+    __atomic_store_n (&blinking, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock (&blinking_lock);
+}
+
+/* rates_changed - wake up the scheduler, unless it is awake already
+
+   Only the first change after the scheduler looked at the queue
+   writes to kickfd, and notes its time in kick_ns, unless an older
+   time was not taken yet.
+*/
+static void
+rates_changed (void)
+{
+  if (!__atomic_exchange_n (&kick_pending, 1, __ATOMIC_ACQ_REL))
+  {
+    struct timespec now;
+    uint64_t        none = 0;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    __atomic_compare_exchange_n (&kick_ns, &none,
+                                 (uint64_t) now.tv_sec * 1000000000 +
+                                 now.tv_nsec, 0, __ATOMIC_RELEASE,
+                                 __ATOMIC_RELAXED);
+    scheduler_kick ();
+  }
+}
+
+/* follow_panels - let the panel LEDs follow their changed rates */
+static void
+follow_panels (uint64_t now)
+{
+  int w;
+
+  for (w = 0; w < (npanels + LONG_BITS - 1) / LONG_BITS; w++)
+  {
+    unsigned long bits = __atomic_exchange_n (&panel_dirty[w], 0,
+                                              __ATOMIC_ACQUIRE);
+
+    while (bits)
+    {
+      int panel = w * LONG_BITS + __builtin_ctzl (bits);
+      int r     = __atomic_load_n (&panel_rate[panel], __ATOMIC_RELAXED);
+
+      bits &= bits - 1;
+      if (r != channels[CHANNEL_LEDS + panel].rate)
+      {
+        channel_follow (CHANNEL_LEDS + panel, r, now);
+      }
+    }
+  }
+}
+
+/* show_panel - switch a panel LED, called by the channels */
+static void
+show_panel (int c,
+            int on)
+{
+  struct timespec start;
+
+  open_leds ();
+  STATS_INC (STAT_IOCTLS);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  if (backend->set (c - CHANNEL_LEDS, on))
+  {
+    STATS_INC (STAT_IOCTLS_FAILED);
+    LOGERR1 ("%s backend: set %m", backend->name);
+    return;
+  }
+  stats_record (HIST_DEVICE_APPLY, stats_elapsed_us (&start));
+  leds_touched = 1;
+}
+
+/* open_leds - open the LED device, if it is not open yet */
+static void
+open_leds (void)
+{
+  if (device_open)
+  {
+    return;
+  }
+  STATS_INC (STAT_CONSOLE_OPENS);
+  if (backend->open (backend_arg))
+  {
+    SYSLOGERR1 ("%s backend: open() %m", backend->name);
+    _exit (EXIT_FAILURE);       /* no need to clear_led_on_exit */
+  }
+  device_open = 1;
+}
+
+/* scheduler - the one thread blinking all LEDs
+
+   Every LED runs through its own pattern as a channel, but all edges
+   of the keyboard LEDs due at the same time are applied with one
+   control_leds() call, panel LEDs are switched as they change.  The
+   thread sleeps on a timerfd armed for the next tick of the timer
+   wheel.  When no LED has anything to do, no timer is armed at all
+   and only scheduler_kick() wakes the thread up again.  Rate changes
+   taken from the command queue within coalesce_ms are folded and
+   applied together, as one transition of the LEDs.
+*/
+static void *
+scheduler (void *unused)
+{
+  struct pollfd   fds[4];
+  struct timespec since;        /* first change in the window */
+  uint64_t        coalesced  = 0; /* end of the coalescing window */
+  cmd_batch_t     folded;       /* changes taken from the queue */
+  int             folding    = 0;
+  int             lit        = 0; /* LEDs switched on by the patterns */
+  int             vt_changed = 0;
+
+  fds[0].fd     = timerfd;
+  fds[0].events = POLLIN;
+  fds[1].fd     = kickfd;
+  fds[1].events = POLLIN;
+  fds[2].fd     = vtfd;         /* ignored by poll() if -1 */
+  fds[2].events = POLLPRI;
+  fds[3].events = POLLIN;       /* LED devices coming and going */
+  while (1)
+  {
+    struct itimerspec its;
+    struct timespec   now;
+    cmd_batch_t       batch;
+    uint64_t          count, ms, next, kicked;
+    int               i, new_lit = 0, on = 0, cycle_done = 0, applied = 0;
+
+    if (__atomic_load_n (&stopping, __ATOMIC_ACQUIRE))
+    {
+      clear_led_on_exit (0);    /* asked for by another thread */
+    }
+    /* look at the queue only after clearing kick_pending, so no
+       change can get lost in between */
+    __atomic_exchange_n (&kick_pending, 0, __ATOMIC_ACQ_REL);
+    kicked = __atomic_exchange_n (&kick_ns, 0, __ATOMIC_ACQUIRE);
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    ms = ts_to_ms (&now);
+    while (cmdq_pop (&batch))
+    {
+      if (!folding)
+      {
+        folding   = 1;
+        since     = now;
+        if (kicked)
+        {
+          since.tv_sec  = kicked / 1000000000;
+          since.tv_nsec = kicked % 1000000000;
+        }
+        coalesced = ms + coalesce_ms;
+        cmdq_clear (&folded);
+      }
+      cmdq_fold (&folded, &batch);
+    }
+    if (folding && ms >= coalesced)
+    {
+      folding = 0;
+      applied = 1;
+    }
+    for (i = BLINKD_CAP; applied && i < BLINKD_ALL; i++)
+    {
+      int r = __atomic_load_n (&rate[i], __ATOMIC_RELAXED);
+
+      if (r != LED_UNUSED &&
+          (r = cmdq_apply (&folded, i, r)) != channels[i].rate)
+      {
+        __atomic_store_n (&rate[i], r, __ATOMIC_RELAXED);
+        channel_follow (i, r, ms);
+      }
+    }
+    if (applied)
+    {
+      follow_panels (ms);
+    }
+    STATS_ADD (STAT_EDGES, channels_run (ms, &cycle_done));
+    for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+    {
+      if (channel_on (i))
+      {
+        new_lit |= leds[i];
+        on      |= 1 << i;
+      }
+    }
+    if (applied || new_lit != lit)
+    {
+      state_publish (rate, on);
+    }
+    if (new_lit != lit || (vt_changed && lit))
+    {
+      open_leds ();
+      control_leds (new_lit);
+      lit = new_lit;
+    }
+    if (applied)
+    {
+      unsigned long usec = stats_elapsed_us (&since);
+
+      stats_record (HIST_DECODE_APPLY, usec);
+      log_msg (LOG_DEBUG, "rate change applied after %lu us", usec);
+    }
+    vt_changed = 0;
+    if (cycle_done && device_open
+        && backend->flags & BACKEND_VT
+        && !noreopen            /* allow closing/reopening /dev/console */
+        && vtfd == -1)          /* tty switches are not reported */
+    {
+      /* we have to open/close again and again, to follow the current
+         virtual tty */
+      close_leds ();
     }
-    else if (childpid > 0)
+    else if (cycle_done)
     {
-      exit (EXIT_SUCCESS);      /* parent */
+      led_shadow = LED_UNKNOWN; /* catch changes by others once a cycle */
     }
 
-    /* The 1st child disassociates from controlling terminal and
-       process group. */
-    if (setpgrp () == -1)
+    /* arm the timer for the next tick to run, or not at all */
+    memset (&its, 0, sizeof (its));
+    next = channels_next ();
+    if (folding && coalesced < next)
     {
-      perror ("setpgrp");
-      exit (EXIT_FAILURE);
+      next = coalesced;
     }
-    signal (SIGHUP, SIG_IGN);
-    if ((childpid = fork ()) < 0)
+    if (next != WHEEL_NONE)
     {
-      perror ("fork");
-      exit (EXIT_FAILURE);
+      ms_to_ts (next, &its.it_value);
     }
-    else if (childpid > 0)
+    if (timerfd_settime (timerfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
     {
-      exit (EXIT_SUCCESS);      /* parent */
+      LOGERR ("timerfd_settime() %m");
+    }
+    fds[3].fd = (device_open && backend->watch)? backend->watch (): -1;
+    if (poll (fds, 4, -1) == -1 && errno != EINTR)
+    {
+      LOGERR ("poll() %m");
+    }
+    if (fds[0].revents & POLLIN &&
+        read (timerfd, &count, sizeof (count)) == -1 && errno != EAGAIN)
+    {
+      LOGERR ("read() %m");
+    }
+    if (fds[1].revents & POLLIN &&
+        read (kickfd, &count, sizeof (count)) == -1 && errno != EAGAIN)
+    {
+      LOGERR ("read() %m");
+    }
+    if (fds[3].revents & POLLIN && backend->hotplug ())
+    {
+      LOGERR1 ("%s backend: hotplug %m", backend->name);
+    }
+    if (fds[2].revents & (POLLPRI | POLLERR) && read_active_vt ())
+    {
+      /* follow the new foreground tty, its LEDs have their own state */
+      vt_changed = 1;
+      if (device_open && !noreopen)
+      {
+        close_leds ();
+      }
+      led_shadow = LED_UNKNOWN;
     }
   }
+  return unused;                /* never reached */
+}
 
-  for (fd = 0; fd <= STDERR_FILENO; fd++)
+/* read_active_vt - read the foreground tty, return 1 if it changed */
+static int
+read_active_vt (void)
+{
+  char    buf[sizeof (active_vt)];
+  ssize_t rr;
+
+  if ((rr = pread (vtfd, buf, sizeof (buf) - 1, 0)) < 0)
   {
-    if (close (fd) == -1)
-    {
-      SYSLOGERR ("close() %m");
-    }
+    LOGERR1 ("read() on %s %m", VT_ACTIVE_FILE);
+    return 0;
   }
-  if (chdir ("/tmp") == -1)
+  buf[rr] = '\0';
+  if (!strcmp (buf, active_vt))
   {
-    SYSLOGERR ("chdir() %m");
+    return 0;
   }
-  umask (0);
+  strcpy (active_vt, buf);
+  return 1;
 }
 
-/* wait_for_connect - endless loop, wait for tcp connections and update data */
+/* scheduler_kick - wake up the scheduler to look at the rates again */
 static void
-wait_for_connect (void)
+scheduler_kick (void)
 {
-  unsigned char      c = '\0';
-  unsigned int       clilen, rr;
-  struct sockaddr_in cli_addr;
-  int                newsockfd;
+  uint64_t one = 1;
 
-  clilen = sizeof (cli_addr);
-  /* The main loop */
-  while (1)
+  if (kickfd != -1 && write (kickfd, &one, sizeof (one)) == -1 &&
+      errno != EAGAIN)
   {
-    if ((newsockfd = accept (sockfd, &cli_addr, &clilen)) == -1)
-    {
-      if (errno != EAGAIN)
-      {
-        SYSLOGERR ("accept() %m");
-        exit (EXIT_FAILURE);
-      }
-    }
-    else
-    {
-      if ((rr = read (newsockfd, &c, 1)) == 1)
-      {
-        int  current_led = (c >> 6) & 0x03;
-        char new_rate    = c        & 0x1f;
-
-        if ((current_led > BLINKD_ALL) || (current_led < BLINKD_CAP) ||
-            (new_rate > RATE_DEC) || (new_rate < 0))
-        {
-          SYSLOGERR1 ("Received inappropriate blink rate 0x%0x", c);
-        }
-        SYSLOGERR2 ("Received appropriate blink rate 0x%0x", c);
-        SYSLOGERR2 ("current_led: %d", current_led);
-        SYSLOGERR2 ("new_rate: %d", new_rate);
-        if (current_led != BLINKD_ALL)
-        {
-          if (new_rate == RATE_INC)
-          {
-            rate[current_led]++;
-          }
-          else if (new_rate == RATE_DEC)
-          {
-            rate[current_led]--;
-          }
-          else
-          {
-            rate[current_led] = new_rate;
-          }
-        }
-        else                    /* resetting all LEDs */
-        {
-          rate[BLINKD_CAP] = (rate[BLINKD_CAP] == -1)? -1: 0;
-          rate[BLINKD_NUM] = (rate[BLINKD_NUM] == -1)? -1: 0;
-          rate[BLINKD_SCR] = (rate[BLINKD_SCR] == -1)? -1: 0;
-        }
-      }
-      else if (rr == -1)
-      {
-        SYSLOGERR ("read() %m");
-      }
-      else if (rr)
-      {
-        SYSLOGERR1 ("read() returned %d", rr);
-      }
-      if (close (newsockfd) == -1)
-      {
-        SYSLOGERR ("close() %m");
-      }
-    }
+    LOGERR ("write() %m");
   }
 }
 
-void *
-loop (void *led)
+/* ts_to_ms - milli seconds from the start of the channels to a time */
+static uint64_t
+ts_to_ms (const struct timespec *ts)
 {
-  while (1)
+  long   nsec = ts->tv_nsec - epoch.tv_nsec;
+  time_t sec  = ts->tv_sec - epoch.tv_sec;
+
+  if (nsec < 0)
   {
-    if (rate [(int) led])       /* only if there is something to do */
-    {
-      int i;
+    sec--;
+    nsec += 1000000000;
+  }
+  return (uint64_t) sec * 1000 + nsec / 1000000;
+}
 
-      /* we have to open/close again and again, to follow the current
-         virtual tty */
-      if (!keyboardDevice)
-      {
-        pthread_mutex_lock (&key_mutex);
-        if ((keyboardDevice = open (KEYBOARDDEVICE, O_RDONLY)) == -1)
-        {
-          SYSLOGERR1 ("open() on %s %m", KEYBOARDDEVICE);
-          _exit (EXIT_FAILURE); /* no need to clear_led_on_exit */
-        }
-        pthread_mutex_unlock (&key_mutex);
-      }
-      for (i = 0; i < rate[(int) led]; i++)
-      {
-        pthread_mutex_lock (&key_mutex);
-        control_led (SET, leds[(int) led]);
-        pthread_mutex_unlock (&key_mutex);
-        usleep (on_time * SLEEPFACTOR);
-        pthread_mutex_lock (&key_mutex);
-        control_led (CLEAR, leds[(int) led]);
-        pthread_mutex_unlock (&key_mutex);
-        usleep (off_time * SLEEPFACTOR);
-      }
-      usleep (pause_time * SLEEPFACTOR);
-      if (keyboardDevice        /* device is open */
-          && !noreopen)         /* allow closing/reopening /dev/console */
-      {
-        pthread_mutex_lock (&key_mutex);
-        if (close (keyboardDevice) == -1)
-        {
-          SYSLOGERR ("close() %m");
-        }
-        keyboardDevice = 0;     /* reset for reopening and
-                                   clear_led_on_exit */
-        pthread_mutex_unlock (&key_mutex);
-      }
-    }
-    else
-    {
-      sleep (1);
-    }
+/* ms_to_ts - the time ms milli seconds after the start of the channels */
+static void
+ms_to_ts (uint64_t ms,
+          struct timespec *ts)
+{
+  ts->tv_sec  = epoch.tv_sec + ms / 1000;
+  ts->tv_nsec = epoch.tv_nsec + (ms % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
   }
-  return NULL;                  /* never reached */
 }
 
 /* process_opts - process command line, see function usage() for options */
@@ -436,7 +1914,21 @@ process_opts (int argc,
     unsigned int noreopen : 1;
     unsigned int scr      : 1;
     unsigned int tcp      : 1;
+    unsigned int local    : 1;
+    unsigned int udp      : 1;
+    unsigned int dgram    : 1;
+    unsigned int loglevel : 1;
+    unsigned int backend  : 1;
+    unsigned int fg       : 1;
+    unsigned int coalesce : 1;
+    unsigned int backlog  : 1;
+    unsigned int accept   : 1;
+    unsigned int channels : 1;
+    unsigned int state    : 1;
+    unsigned int ring     : 1;
+    unsigned int inetd    : 1;
   } flags;
+  char *end;
 
   memset (&flags, 0, sizeof (flags));
   while (1)
@@ -444,19 +1936,34 @@ process_opts (int argc,
     int option_index                    = 0;
     static struct option long_options[] =
     {
+      {"acceptors",     1, 0, 'A'},
+      {"backend",       1, 0, 'B'},
+      {"backlog",       1, 0, 'b'},
+      {"coalesce",      1, 0, 'C'},
       {"capslockled",   0, 0, 'c'},
+      {"dgram-socket",  1, 0, 'd'},
+      {"foreground",    0, 0, 'F'},
       {"off-time",      1, 0, 'f'},
       {"help",          0, 0, 'h'},
+      {"inetd",         0, 0, 'i'},
+      {"log-level",     1, 0, 'L'},
+      {"channels",      1, 0, 'N'},
       {"numlockled",    0, 0, 'n'},
       {"on-time",       1, 0, 'o'},
+      {"pattern",       1, 0, 'P'},
       {"pause",         1, 0, 'p'},
+      {"ring",          1, 0, 'R'},
       {"no-reopen",     0, 0, 'r'},
       {"scrolllockled", 0, 0, 's'},
+      {"state",         1, 0, 'S'},
       {"tcp-port",      1, 0, 't'},
+      {"udp-port",      1, 0, 'U'},
+      {"unix-socket",   1, 0, 'u'},
       {"version",       0, 0, 'v'},
+      {"watch",         1, 0, 'w'},
       {0,               0, 0, 0}
     };
-    c = getopt_long (argc, argv, "cf:hno:p:rst:v",
+    c = getopt_long (argc, argv, "A:B:b:C:cd:Ff:hiL:N:no:P:p:R:rsS:t:U:u:vw:",
                      long_options, &option_index);
     if (c == -1)
     {
@@ -464,6 +1971,57 @@ process_opts (int argc,
     }
     switch (c)
     {
+      case 'A':
+        if (flags.accept)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.accept = 1;
+        acceptors    = atoi (optarg);
+        if (acceptors < 1 || acceptors > 64)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'B':
+        if (flags.backend)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.backend = 1;
+        if ((backend = backend_find (optarg)) == NULL)
+        {
+          wrong_use (argv[0]);
+        }
+        if ((backend_arg = strchr (optarg, ':')) != NULL)
+        {
+          backend_arg++;
+        }
+        break;
+      case 'b':
+        if (flags.backlog)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.backlog  = 1;
+        listen_backlog = atoi (optarg);
+        if (listen_backlog < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'C':
+        if (flags.coalesce)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.coalesce = 1;
+        coalesce_ms    = atoi (optarg);
+        if (coalesce_ms < 0 || coalesce_ms > 10000)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
       case 'c':
         if (flags.cap)
         {
@@ -472,17 +2030,64 @@ process_opts (int argc,
         flags.cap        = 1;
         rate[BLINKD_CAP] = 0;
         break;
+      case 'd':
+        if (flags.dgram)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.dgram = 1;
+        dgram_path  = optarg;
+        break;
+      case 'F':
+        if (flags.fg)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.fg   = 1;
+        foreground = 1;
+        break;
       case 'f':
         if (flags.off_time)
         {
           wrong_use (argv[0]);
         }
         flags.off_time = 1;
-        off_time       = atoi (optarg);
+        off_time       = pattern_time (optarg, &end);
+        if (off_time == -1 || *end)
+        {
+          wrong_use (argv[0]);
+        }
         break;
       case 'h':
         usage (argv[0]);
         exit (EXIT_SUCCESS);
+      case 'i':
+        if (flags.inetd)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.inetd = 1;
+        inetd       = 1;
+        break;
+      case 'L':
+        if (flags.loglevel || (log_level = log_parse_level (optarg)) == -1)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.loglevel = 1;
+        break;
+      case 'N':
+        if (flags.channels)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.channels = 1;
+        npanels        = atoi (optarg);
+        if (npanels < 0 || npanels > BLINKD_CHANNEL_MAX + 1 - CHANNEL_LEDS)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
       case 'n':
         if (flags.num)
         {
@@ -497,7 +2102,11 @@ process_opts (int argc,
           wrong_use (argv[0]);
         }
         flags.on_time = 1;
-        on_time       = atoi (optarg);
+        on_time       = pattern_time (optarg, &end);
+        if (on_time == -1 || *end)
+        {
+          wrong_use (argv[0]);
+        }
         break;
       case 'p':
         if (flags.pause)
@@ -505,7 +2114,19 @@ process_opts (int argc,
           wrong_use (argv[0]);
         }
         flags.pause = 1;
-        pause_time  = atoi (optarg);
+        pause_time  = pattern_time (optarg, &end);
+        if (pause_time == -1 || *end)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'R':
+        if (flags.ring)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.ring = 1;
+        ring_name  = optarg;
         break;
       case 'r':
         if (flags.noreopen)
@@ -523,6 +2144,14 @@ process_opts (int argc,
         flags.scr        = 1;
         rate[BLINKD_SCR] = 0;
         break;
+      case 'S':
+        if (flags.state)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.state = 1;
+        state_name  = optarg;
+        break;
       case 't':
         if (flags.tcp)
         {
@@ -531,6 +2160,34 @@ process_opts (int argc,
         flags.tcp      = 1;
         serv_tcp_port  = atoi (optarg);
         break;
+      case 'U':
+        if (flags.udp)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.udp     = 1;
+        serv_udp_port = atoi (optarg);
+        break;
+      case 'u':
+        if (flags.local)
+        {
+          wrong_use (argv[0]);
+        }
+        flags.local = 1;
+        unix_path  = optarg;
+        break;
+      case 'P':
+        if (parse_pattern (optarg) == -1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'w':
+        if (parse_watch (optarg) == -1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
       case 'v':
         puts (PACKAGE " " VERSION);
         exit (EXIT_SUCCESS);
@@ -543,6 +2200,14 @@ process_opts (int argc,
   {
     wrong_use (argv[0]);
   }
+  if (npanels && backend->set == NULL) /* backend without panel LEDs */
+  {
+    wrong_use (argv[0]);
+  }
+  if (!flags.udp)
+  {
+    serv_udp_port = serv_tcp_port;
+  }
 
   /* No LEDs specified, assuming all LEDs! */
   if (!flags.cap && !flags.num && !flags.scr)
@@ -551,39 +2216,161 @@ process_opts (int argc,
     rate[BLINKD_NUM] = 0;
     rate[BLINKD_SCR] = 0;
   }
+  for (c = BLINKD_CAP; c < BLINKD_ALL; c++)
+  {
+    if (watch_dir[c] != NULL && rate[c] == LED_UNUSED)
+    {
+      rate[c] = 0;              /* watched LEDs are always in use */
+    }
+  }
 }
 
-/* threads_start - start 1..3 threads */
+/* panels_start - the rates of the panel LEDs, set before the scheduler
+   runs */
 static void
-threads_start (void)
+panels_start (void)
 {
+  if ((panel_rate = calloc (npanels + 1, sizeof (*panel_rate))) == NULL ||
+      (panel_dirty = calloc (npanels / LONG_BITS + 1,
+                             sizeof (*panel_dirty))) == NULL)
+  {
+    SYSLOGERR ("malloc() %m");
+    exit (EXIT_FAILURE);
+  }
+}
 
-  pthread_mutex_init (&key_mutex, NULL);
+/* scheduler_start - start the thread blinking the LEDs in use */
+static void
+scheduler_start (void)
+{
+  const pattern_t *count;
+  int              i;
 
-  if (rate[BLINKD_CAP] != -1 &&
-      pthread_create (&cap_thread,
-                      NULL,
-                      &loop,
-                      (void *) BLINKD_CAP))
+  if ((count = pattern_count (on_time, off_time, pause_time)) == NULL)
   {
-    SYSLOGERR ("pthread_create");
+    SYSLOGERR ("malloc() %m");
+    exit (EXIT_FAILURE);
   }
-  if (rate[BLINKD_NUM] != -1 &&
-      pthread_create (&num_thread,
-                      NULL,
-                      &loop,
-                      (void *) BLINKD_NUM))
+  clock_gettime (CLOCK_MONOTONIC, &epoch);
+  if (channels_start (CHANNEL_LEDS + npanels,
+                      (patterns[BLINKD_ALL] != NULL)? patterns[BLINKD_ALL]:
+                                                      count,
+                      show_panel, 0) == -1)
   {
-    SYSLOGERR ("pthread_create");
+    SYSLOGERR ("malloc() %m");
+    exit (EXIT_FAILURE);
+  }
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    channels[i].pattern = (patterns[i] != NULL)? patterns[i]: count;
+    channels[i].rate    = rate[i];
+    if (rate[i] != LED_UNUSED)
+    {
+      managed_leds |= leds[i];
+    }
+  }
+  if ((timerfd = timerfd_create (CLOCK_MONOTONIC,
+                                 TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+      (kickfd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+  {
+    SYSLOGERR ("timerfd_create()/eventfd() %m");
+    exit (EXIT_FAILURE);
   }
-  if (rate[BLINKD_SCR] != -1 &&
-      pthread_create (&scr_thread,
-                      NULL,
-                      &loop,
-                      (void *) BLINKD_SCR))
+  /* Without tty switch notifications, the console is reopened after
+     every cycle instead. */
+  if (backend->flags & BACKEND_VT &&
+      (vtfd = open (VT_ACTIVE_FILE, O_RDONLY | O_CLOEXEC)) != -1)
+  {
+    read_active_vt ();          /* poll() reports changes after a read */
+  }
+  if (pthread_create (&scheduler_thread, NULL, &scheduler, NULL))
   {
     SYSLOGERR ("pthread_create");
+    exit (EXIT_FAILURE);
+  }
+}
+
+/* start_watches - start watching the spool directories given */
+static void
+start_watches (void)
+{
+  int i;
+
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    if (watch_dir[i] != NULL &&
+        (watches[i] = watch_new (watch_dir[i], watch_sep[i])) == NULL)
+    {
+      SYSLOGERR1 ("watching %s %m", watch_dir[i]);
+      exit (EXIT_FAILURE);
+    }
+  }
+}
+
+/* parse_led - the LED for "caps", "num" or "scroll", or -1 */
+static int
+parse_led (const char *name)
+{
+  static const char *names[3] = { "caps", "num", "scroll" };
+  int                led;
+
+  for (led = BLINKD_CAP; led < BLINKD_ALL; led++)
+  {
+    if (!strcmp (name, names[led]))
+    {
+      return led;
+    }
+  }
+  return -1;
+}
+
+/* parse_pattern - set the pattern of "led:pattern", return the LED or -1
+
+   The LED "panel" sets the pattern of all panel LEDs.
+*/
+static int
+parse_pattern (char *spec)
+{
+  char *desc;
+  int   led;
+
+  if ((desc = strchr (spec, ':')) == NULL)
+  {
+    return -1;
+  }
+  *desc++ = '\0';
+  led = strcmp (spec, "panel")? parse_led (spec): BLINKD_ALL;
+  if (led == -1 || patterns[led] != NULL ||
+      (patterns[led] = pattern_parse (desc)) == NULL)
+  {
+    return -1;
+  }
+  return led;
+}
+
+/* parse_watch - split "led:dir[:separators]", return the LED or -1 */
+static int
+parse_watch (char *spec)
+{
+  char *dir, *sep;
+  int   led;
+
+  if ((dir = strchr (spec, ':')) == NULL)
+  {
+    return -1;
+  }
+  *dir++ = '\0';
+  if ((led = parse_led (spec)) == -1 || !*dir || watch_dir[led] != NULL)
+  {
+    return -1;
+  }
+  if ((sep = strchr (dir, ':')) != NULL)
+  {
+    *sep++ = '\0';
   }
+  watch_dir[led] = dir;
+  watch_sep[led] = (sep != NULL)? sep: ".";
+  return led;
 }
 
 /* usage - help on options */
@@ -592,18 +2379,39 @@ usage (char* name)
 {
   printf (_("Usage: %s [options]\n"
             "Options are\n"
+            "  -A n, --acceptors=n   accept tcp connections in n threads\n"
+            "  -B b, --backend=b     use LED backend b[:arg] (console,\n"
+            "                        evdev, sysfs, mock)\n"
+            "  -b n, --backlog=n     queue up to n connections (%d)\n"
+            "  -C m, --coalesce=m    fold rate changes within m ms (0)\n"
             "  -c,   --capslockled   use Caps-Lock LED\n"
+            "  -d s, --dgram-socket=s use local datagram socket s\n"
+            "  -F,   --foreground    do not become a daemon\n"
             "  -f t, --off-time=t    set off blink time to t\n"
             "  -h,   --help          display this help and exit\n"
+            "  -i,   --inetd         serve the socket inetd passes on stdin\n"
+            "  -L l, --log-level=l   log up to priority l (info)\n"
+            "  -N n, --channels=n    drive n panel LEDs too (sysfs, mock)\n"
             "  -n,   --numlockled    use Num-Lock LED\n"
             "  -o t, --on-time=t     set on blink time to t\n"
+            "  -P p, --pattern=p     blink as led:pattern, led may be\n"
+            "                        panel, pattern is count[:on,off,\n"
+            "                        pause], heartbeat, sos, sweep or\n"
+            "                        morse:text\n"
             "  -p t, --pause=t       set pause time to t\n"
+            "  -R s, --ring=s        take commands from shared memory ring s\n"
             "  -r,   --no-reopen     don't reopen /dev/console\n"
             "  -s,   --scrolllockled use Scroll-Lock LED\n"
+            "  -S s, --state=s       publish the LED state as shared memory s\n"
+            "                        (\"\" for none)\n"
             "  -t n, --tcp-port=n    use tcp port n\n"
+            "  -U n, --udp-port=n    use udp port n (0 for none)\n"
+            "  -u s, --unix-socket=s use local socket s (\"\" for none)\n"
             "  -v,   --version       output version information and exit\n"
-            "Unit for all time values t is tenth of a second.\n"),
-            name);
+            "  -w w, --watch=w       count messages as led:dir[:separators]\n"
+            "Time values t are in tenths of a second, or in ms or s\n"
+            "with that unit, e.g. 250ms.\n"),
+            name, SOMAXCONN);
 }
 
 /* wrong_use - output for the user, if options cannot be interpreted */
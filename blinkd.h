@@ -17,7 +17,121 @@
    MA 02110-1301, USA.
 */
 
+#include <stdint.h>
+
+#ifndef BLINKD_SOCKET_PATH      /* local socket, "@name" is abstract */
+#define BLINKD_SOCKET_PATH "/var/run/blinkd.socket"
+#endif
+
+#ifndef BLINKD_DGRAM_PATH       /* local datagram socket */
+#define BLINKD_DGRAM_PATH "/var/run/blinkd.dgram"
+#endif
+
+#define BLINKD_DGRAM_MAX 1024   /* command octets per datagram */
+
 #define RATE_DEC 0x1F           /* '00111111'B */
 #define RATE_INC (RATE_DEC - 1) /* '00111110'B */
 
+/* Octets with this bit set are requests, not rates.  The reply to a
+   request is text ending with an empty line. */
+#define BLINKD_REQUEST     0x20 /* '00100000'B */
+#define BLINKD_QUERY_STATS (BLINKD_REQUEST | 0x00) /* "name value" lines */
+#define BLINKD_PING        (BLINKD_REQUEST | 0x01) /* just the empty line */
+
+/* Protocol v2: frames of a header and up to BLINKD_FRAME_MAX octets of
+   commands, all applied at once.  The header is BLINKD_V2, flags and
+   the payload length in network order.  A connection speaks v2 if its
+   first octet is BLINKD_V2, which is no v1 command; a datagram if it
+   starts with it.  With BLINKD_F_ACK the payload starts with a request
+   id of 2 octets and blinkd replies with a frame flagged BLINKD_F_REPLY
+   carrying the id, a status and the answers to the queries in order:
+   BLINKD_Q_RATES gives 3 rates of 2 octets, BLINKD_RATE_NONE for LEDs
+   not in use, BLINKD_Q_STATS 2 octets of length and the statistics.
+   Frames with queries are answered even without BLINKD_F_ACK.  A frame
+   with a bad command is not applied at all.  BLINKD_OP_SET_CH and
+   BLINKD_OP_ADD_CH address channels by a number of 2 octets: 0 to 2
+   are the LEDs, the panel LEDs of blinkd --channels follow.  Panel
+   LEDs take their rates as they come, not all at once per frame. */
+#define BLINKD_V2          0xE2 /* '11100010'B */
+#define BLINKD_HDR_SIZE    4
+#define BLINKD_FRAME_MAX   4096
+#define BLINKD_F_ACK       0x01
+#define BLINKD_F_REPLY     0x80
+#define BLINKD_OP_SET      0x01 /* led, rate (2 octets) */
+#define BLINKD_OP_ADD      0x02 /* led, signed delta (2 octets) */
+#define BLINKD_OP_RESET    0x03 /* all LEDs to 0 */
+#define BLINKD_OP_QUERY    0x04 /* what */
+#define BLINKD_OP_SET_CH   0x05 /* channel (2 octets), rate (2 octets) */
+#define BLINKD_OP_ADD_CH   0x06 /* channel (2 octets), signed delta */
+#define BLINKD_Q_RATES     0x00
+#define BLINKD_Q_STATS     0x01
+#define BLINKD_RATE_MAX    0xFFFE
+#define BLINKD_RATE_NONE   0xFFFF
+#define BLINKD_CHANNEL_MAX 0xFFFF
+#define BLINKD_OK          0x00 /* status */
+#define BLINKD_EBADCMD     0x01
+
+/* The LED state, published by blinkd in the POSIX shared memory
+   object BLINKD_STATE_NAME, read-only for everybody else.  seq is a
+   seqlock: it is odd while blinkd writes, so readers copy the rest
+   and start over if seq was odd or changed meanwhile.  rate is
+   BLINKD_RATE_NONE for LEDs not in use, bit i of lit is set while LED
+   i is on, times are in ms, updated_ns is CLOCK_REALTIME.  pid is 0
+   once blinkd has exited.  Fields are in host order, new ones are
+   added at the end with a new version. */
+#ifndef BLINKD_STATE_NAME
+#define BLINKD_STATE_NAME "/blinkd"
+#endif
+#define BLINKD_STATE_VERSION 1
+
+typedef struct {
+  uint32_t seq;
+  uint32_t version;             /* BLINKD_STATE_VERSION */
+  uint64_t generation;          /* updates published */
+  uint64_t updated_ns;
+  uint32_t pid;
+  uint32_t channels;            /* panel LEDs after the three */
+  uint32_t lit;
+  uint32_t on_ms;
+  uint32_t off_ms;
+  uint32_t pause_ms;
+  uint16_t rate[3];
+  uint16_t unused;
+} blinkd_state_t;
+
+/* The command ring of blinkd --ring, a POSIX shared memory object
+   with a blinkd_ring_t followed by size records.  Local processes
+   push records without a syscall, each carries what a datagram would:
+   command octets or v2 frames.  A producer takes a ticket t from head
+   with compare-and-swap, waits for record t % size to have seq t,
+   fills it and sets seq to t + 1.  blinkd takes records in ticket
+   order and sets seq to t + size once done with them.  Before it
+   sleeps, blinkd sets sleeping to 1 and looks once more, a producer
+   finding it 1 resets it and wakes blinkd with FUTEX_WAKE, so only a
+   push to an empty ring costs a syscall.  A producer dying between
+   taking its ticket and setting seq stops the ring.  pid is the one
+   of the blinkd taking the records. */
+#ifndef BLINKD_RING_NAME
+#define BLINKD_RING_NAME "/blinkd.ring"
+#endif
+#define BLINKD_RING_VERSION 1
+#define BLINKD_RING_DATA    26  /* octets per record */
+
+typedef struct {
+  uint32_t      seq;
+  uint16_t      len;
+  unsigned char data[BLINKD_RING_DATA];
+} blinkd_record_t;
+
+typedef struct {
+  uint32_t version;             /* BLINKD_RING_VERSION, set last */
+  uint32_t size;                /* records, a power of 2 */
+  uint32_t pid;                 /* of blinkd */
+  uint32_t pad0[13];            /* head on a cache line of its own */
+  uint32_t head;                /* next ticket */
+  uint32_t pad1[15];
+  uint32_t sleeping;            /* futex */
+  uint32_t pad2[15];
+} blinkd_ring_t;
+
 typedef enum {BLINKD_CAP, BLINKD_NUM, BLINKD_SCR, BLINKD_ALL} leds_t;
@@ -0,0 +1,231 @@
+/* File: channel-bench.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Benchmark of the channels of blinkd.  Runs thousands of panel LEDs
+   on the mock backend through the timer wheel in simulated time, as
+   fast as possible, and reports the cost per edge for several numbers
+   of channels.  With a scheduling cost independent of the number of
+   channels, ns_per_edge stays flat.  Results are "name value" lines or
+   one JSON object per run. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <backend.h>
+#include <pattern.h>
+#include <channel.h>
+#include <wheel.h>
+
+/* macros */
+#define RATES           5       /* panel LEDs blink at rates 1..RATES */
+
+/* function prototypes */
+static unsigned long now_ns       (void);
+static void          process_opts (int, char **);
+static void          run          (const pattern_t *, int);
+static void          show         (int, int);
+static void          usage        (char *);
+static void          wrong_use    (char *);
+
+/* global variables */
+static int           counts[]   = { 10, 100, 1000, 10000, 100000 };
+static int           panels     = 0;    /* just this number, if set */
+static int           seconds    = 60;   /* simulated time per run */
+static int           json       = 0;
+static unsigned long shown      = 0;
+
+/* main - run the benchmark for every number of channels */
+int
+main (int argc,
+      char **argv)
+{
+  const pattern_t *count;
+  size_t           i;
+
+  process_opts (argc, argv);
+  if ((count = pattern_count (200, 200, 600)) == NULL)
+  {
+    fprintf (stderr, "Out of memory.\n");
+    exit (EXIT_FAILURE);
+  }
+  backend_mock.open (NULL);
+  if (panels)
+  {
+    run (count, panels);
+    return EXIT_SUCCESS;
+  }
+  for (i = 0; i < sizeof (counts) / sizeof (*counts); i++)
+  {
+    run (count, counts[i]);
+  }
+  return EXIT_SUCCESS;
+}
+
+/* run - blink n panel LEDs with pattern count for the simulated time
+
+   The LEDs start a millisecond apart and blink at different rates,
+   so their edges spread over the timeline like those of independent
+   clients.
+*/
+static void
+run (const pattern_t *count,
+     int n)
+{
+  unsigned long start, elapsed, edges = 0, wakeups = 0;
+  uint64_t      now;
+  int           c, cycle_done;
+
+  if (channels_start (CHANNEL_LEDS + n, count, show, 0) == -1)
+  {
+    fprintf (stderr, "Out of memory.\n");
+    exit (EXIT_FAILURE);
+  }
+  for (c = CHANNEL_LEDS; c < nchannels; c++)
+  {
+    channel_follow (c, 1 + c % RATES, c % 1000);
+  }
+  shown = 0;
+  start = now_ns ();
+  while ((now = channels_next ()) <= seconds * 1000UL)
+  {
+    edges += channels_run (now, &cycle_done);
+    wakeups++;
+  }
+  elapsed = now_ns () - start;
+  if (json)
+  {
+    printf ("{\"channels\": %d, \"simulated_s\": %d, \"edges\": %lu, "
+            "\"shown\": %lu, \"wakeups\": %lu, \"elapsed_s\": %.3f, "
+            "\"edges_per_s\": %.0f, \"ns_per_edge\": %.2f}\n",
+            n, seconds, edges, shown, wakeups, elapsed / 1e9,
+            elapsed? edges * 1e9 / elapsed: 0,
+            edges? (double) elapsed / edges: 0);
+  }
+  else
+  {
+    printf ("channels %d\n"
+            "edges %lu\n"
+            "wakeups %lu\n"
+            "edges_per_s %.0f\n"
+            "ns_per_edge %.2f\n",
+            n, edges, wakeups, elapsed? edges * 1e9 / elapsed: 0,
+            edges? (double) elapsed / edges: 0);
+  }
+}
+
+/* show - switch a panel LED of the mock backend */
+static void
+show (int c,
+      int on)
+{
+  backend_mock.set (c - CHANNEL_LEDS, on);
+  shown++;
+}
+
+/* now_ns - monotonic time in nano seconds */
+static unsigned long
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* process_opts - process command line, see function usage() for options */
+static void
+process_opts (int argc,
+              char **argv)
+{
+  int c = 0;
+
+  while (1)
+  {
+    int option_index                    = 0;
+    static struct option long_options[] =
+    {
+      {"channels",      1, 0, 'c'},
+      {"help",          0, 0, 'h'},
+      {"json",          0, 0, 'j'},
+      {"seconds",       1, 0, 's'},
+      {"version",       0, 0, 'v'},
+      {0,               0, 0, 0}
+    };
+    c = getopt_long (argc, argv, "c:hjs:v", long_options, &option_index);
+    if (c == -1)
+    {
+      break;
+    }
+    switch (c)
+    {
+      case 'c':
+        if ((panels = atoi (optarg)) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'h':
+        usage (argv[0]);
+        exit (EXIT_SUCCESS);
+      case 'j':
+        json = 1;
+        break;
+      case 's':
+        if ((seconds = atoi (optarg)) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'v':
+        printf ("channel-bench (%s) %s\n", PACKAGE, VERSION);
+        exit (EXIT_SUCCESS);
+      default:
+        wrong_use (argv[0]);
+    }
+  }
+  if (optind < argc)
+  {
+    wrong_use (argv[0]);
+  }
+}
+
+/* usage - help on options */
+static void
+usage (char* name)
+{
+  printf ("Usage: %s [options]\n"
+          "Options are\n"
+          "  -c n, --channels=n    run n panel LEDs only\n"
+          "  -h,   --help          display this help and exit\n"
+          "  -j,   --json          print the results as JSON\n"
+          "  -s n, --seconds=n     simulate n seconds per run (60)\n"
+          "  -v,   --version       output version information and exit\n",
+          name);
+}
+
+/* wrong_use - output for the user, if options cannot be interpreted */
+static void
+wrong_use (char *name)
+{
+  fprintf (stderr, "%s: Error in arguments.  Try %s --help.\n", name, name);
+  exit (EXIT_FAILURE);
+}
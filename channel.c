@@ -0,0 +1,237 @@
+/* File: channel.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <pattern.h>
+#include <channel.h>
+#include <wheel.h>
+
+/* macros */
+#define MAX_EDGES_PASS  64      /* edges per channel and run */
+
+/* type definitions */
+typedef struct {
+  uint64_t      now;
+  unsigned long edges;
+  int           cycle_done;
+} run_t;
+
+/* function prototypes */
+static void changed   (int c);
+static void fire      (int c, void *arg);
+static int  lit       (int c, int bit);
+static int  neighbour (int c, int step);
+static void next_edge (channel_t *ch, run_t *run, int led);
+static void refresh   (int c);
+
+/* global variables */
+channel_t            *channels  = NULL;
+int                   nchannels = 0;
+static channel_show_t show      = NULL; /* sets a panel LED */
+
+/* channels_start - set up n idle channels running pattern, 0 or -1
+
+   show is called with the panel LEDs that go on or off.  Channels set
+   up before are dropped.
+*/
+int
+channels_start (int n,
+                const pattern_t *pattern,
+                channel_show_t show_fn,
+                uint64_t now)
+{
+  int c;
+
+  free (channels);
+  if ((channels = calloc (n, sizeof (*channels))) == NULL ||
+      wheel_start (n, now) == -1)
+  {
+    return -1;
+  }
+  for (c = 0; c < n; c++)
+  {
+    channels[c].pattern = pattern;
+    channels[c].idle    = 1;
+  }
+  nchannels = n;
+  show      = show_fn;
+  return 0;
+}
+
+/* channel_follow - let a running pattern follow a new rate right away
+
+   Rate 0 switches the channel off.  An idle channel, or one past the
+   repeat step of its pattern, starts a new cycle now.  Within the
+   repeated steps the remaining pulses are adjusted, with none left
+   the pattern goes on after the repeat step.
+*/
+void
+channel_follow (int c,
+                int new_rate,
+                uint64_t now)
+{
+  channel_t       *ch       = &channels[c];
+  const pattern_t *p        = ch->pattern;
+  int              old_rate = ch->rate;
+
+  ch->rate = new_rate;
+  if (new_rate <= 0)
+  {
+    ch->idle = 1;
+    wheel_del (c);
+    changed (c);
+    return;
+  }
+  if (ch->idle || (p->repeat >= 0 && ch->pos.step > p->repeat))
+  {
+    ch->idle = 0;
+    pattern_start (&ch->pos, new_rate);
+  }
+  else if (p->repeat >= 0 &&
+           (ch->pos.left += new_rate - old_rate) <= 0)
+  {
+    ch->pos.step = p->repeat + 1;
+  }
+  else
+  {
+    return;
+  }
+  ch->deadline = now + p->steps[ch->pos.step].ms;
+  wheel_add (c, ch->deadline);
+  changed (c);
+}
+
+/* channel_on - is the LED of channel c lit, by its own pattern or by
+   the one of a neighbour? */
+int
+channel_on (int c)
+{
+  return lit (c, PAT_SELF) || lit (neighbour (c, -1), PAT_NEXT) ||
+         lit (neighbour (c, 1), PAT_PREV);
+}
+
+/* channels_next - the next time channels_run() has anything to do,
+   WHEEL_NONE if all channels are idle */
+uint64_t
+channels_next (void)
+{
+  return wheel_next ();
+}
+
+/* channels_run - take all edges due by now, return their number
+
+   cycle_done is set if a keyboard LED ended a cycle.
+*/
+unsigned long
+channels_run (uint64_t now,
+              int *cycle_done)
+{
+  run_t run;
+
+  run.now        = now;
+  run.edges      = 0;
+  run.cycle_done = 0;
+  wheel_run (now, fire, &run);
+  *cycle_done = run.cycle_done;
+  return run.edges;
+}
+
+/* fire - the step of channel c ended, called by the wheel */
+static void
+fire (int c,
+      void *arg)
+{
+  run_t     *run = arg;
+  channel_t *ch  = &channels[c];
+  int        n;
+
+  for (n = 0; n < MAX_EDGES_PASS && ch->deadline <= run->now; n++)
+  {
+    next_edge (ch, run, c < CHANNEL_LEDS);
+  }
+  wheel_add (c, ch->deadline);
+  changed (c);
+}
+
+/* next_edge - advance the pattern of a channel to its next step
+
+   Deadlines are absolute, so the time spent in here does not add up.
+*/
+static void
+next_edge (channel_t *ch,
+           run_t *run,
+           int led)
+{
+  if (pattern_next (ch->pattern, &ch->pos, ch->rate) && led)
+  {
+    run->cycle_done = 1;
+  }
+  ch->deadline += ch->pattern->steps[ch->pos.step].ms;
+  run->edges++;
+}
+
+/* changed - show the panel LEDs channel c may have switched */
+static void
+changed (int c)
+{
+  if (c < CHANNEL_LEDS)
+  {
+    return;                     /* the scheduler sets them all at once */
+  }
+  refresh (neighbour (c, -1));
+  refresh (c);
+  refresh (neighbour (c, 1));
+}
+
+/* refresh - show a panel LED, if it changed */
+static void
+refresh (int c)
+{
+  int on = channel_on (c);
+
+  if (on != channels[c].on)
+  {
+    channels[c].on = on;
+    show (c, on);
+  }
+}
+
+/* lit - does the current step of channel c light bit? */
+static int
+lit (int c,
+     int bit)
+{
+  const channel_t *ch = &channels[c];
+
+  return !ch->idle && ch->pattern->steps[ch->pos.step].lit & bit;
+}
+
+/* neighbour - the next (step 1) or previous (-1) channel of a group */
+static int
+neighbour (int c,
+           int step)
+{
+  int first = (c < CHANNEL_LEDS)? 0: CHANNEL_LEDS;
+  int end   = (c < CHANNEL_LEDS)? CHANNEL_LEDS: nchannels;
+
+  c += step;
+  return (c < first)? end - 1: (c >= end)? first: c;
+}
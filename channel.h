@@ -0,0 +1,51 @@
+/* File: channel.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Channels of blinkd: every LED blinks its pattern as a channel.  The
+   first CHANNEL_LEDS are the keyboard LEDs, further ones are panel
+   LEDs driven one by one.  Patterns lighting the next or previous LED
+   light the neighbours in the same group, the groups wrap around.
+   All channels live in one array, and their steps are timers on the
+   wheel, so an edge costs the same with any number of them.  Times
+   are milli seconds of the clock the caller counts.  Only the
+   scheduler uses the channels.  Needs pattern.h. */
+
+#include <stdint.h>
+
+#define CHANNEL_LEDS    3       /* Caps, Num and Scroll */
+
+typedef struct {
+  const pattern_t *pattern;
+  pat_pos_t        pos;
+  uint64_t         deadline;    /* end of the current step */
+  int              rate;        /* rate the pattern runs with */
+  unsigned char    idle;        /* rate 0, no steps to take */
+  unsigned char    on;          /* panel LED lit, as shown */
+} channel_t;
+
+typedef void (*channel_show_t) (int c, int on);
+
+extern channel_t *channels;
+extern int        nchannels;
+
+void          channel_follow (int c, int rate, uint64_t now);
+int           channel_on     (int c);
+uint64_t      channels_next  (void);
+unsigned long channels_run   (uint64_t now, int *cycle_done);
+int           channels_start (int n, const pattern_t *pattern,
+                              channel_show_t show, uint64_t now);
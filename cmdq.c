@@ -0,0 +1,199 @@
+/* File: cmdq.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <blinkd.h>
+#include <cmdq.h>
+
+/* macros */
+#define CMDQ_SIZE       1024    /* power of two */
+#define CLAMP(v, lo, hi) ((v) < (lo)? (lo): (v) > (hi)? (hi): (v))
+
+/* type definitions */
+typedef struct {
+  unsigned long seq;            /* slot is free for producer seq,
+                                   readable for consumer seq - 1 */
+  cmd_batch_t   batch;
+} cmd_slot_t;
+
+/* global variables */
+static cmd_slot_t    queue[CMDQ_SIZE];
+static unsigned long queue_head = 0; /* next slot for producers */
+static unsigned long queue_tail = 0; /* next slot for the scheduler */
+
+/* cmdq_start - set up the queue, before any thread uses it */
+void
+cmdq_start (void)
+{
+  int i;
+
+  for (i = 0; i < CMDQ_SIZE; i++)
+  {
+    queue[i].seq = i;
+  }
+}
+
+/* cmdq_clear - make a batch that changes nothing */
+void
+cmdq_clear (cmd_batch_t *b)
+{
+  int i;
+
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    b->led[i].delta = 0;
+    b->led[i].lo    = 0;
+    b->led[i].hi    = BLINKD_RATE_MAX;
+  }
+}
+
+/* cmdq_empty - does the batch change nothing? */
+int
+cmdq_empty (const cmd_batch_t *b)
+{
+  int i;
+
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    if (b->led[i].delta || b->led[i].lo || b->led[i].hi != BLINKD_RATE_MAX)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* cmdq_set - add setting the rate of an LED to a batch */
+void
+cmdq_set (cmd_batch_t *b,
+          int led,
+          int rate)
+{
+  rate              = CLAMP (rate, 0, BLINKD_RATE_MAX);
+  b->led[led].delta = 0;
+  b->led[led].lo    = rate;
+  b->led[led].hi    = rate;
+}
+
+/* cmdq_add - add changing the rate of an LED by delta to a batch */
+void
+cmdq_add (cmd_batch_t *b,
+          int led,
+          int delta)
+{
+  cmd_batch_t later;
+
+  cmdq_clear (&later);
+  later.led[led].delta = CLAMP (delta, -BLINKD_RATE_MAX, BLINKD_RATE_MAX);
+  cmdq_fold (b, &later);
+}
+
+/* cmdq_fold - let a batch also do what later does afterwards
+
+   Clamping a clamped value to lo..hi is the same as clamping it once
+   to the bounds of the first clamped to lo..hi.  Rates start between
+   0 and BLINKD_RATE_MAX, so deltas beyond that need not be kept.
+*/
+void
+cmdq_fold (cmd_batch_t *b,
+           const cmd_batch_t *later)
+{
+  int i;
+
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    cmd_op_t       *op = &b->led[i];
+    const cmd_op_t *l  = &later->led[i];
+
+    op->delta = CLAMP (op->delta + l->delta,
+                       -BLINKD_RATE_MAX, BLINKD_RATE_MAX);
+    op->lo    = CLAMP (op->lo + l->delta, l->lo, l->hi);
+    op->hi    = CLAMP (op->hi + l->delta, l->lo, l->hi);
+  }
+}
+
+/* cmdq_apply - the rate of an LED after a batch */
+int
+cmdq_apply (const cmd_batch_t *b,
+            int led,
+            int rate)
+{
+  const cmd_op_t *op = &b->led[led];
+
+  return CLAMP (rate + op->delta, op->lo, op->hi);
+}
+
+/* cmdq_push - queue a batch for the scheduler, never blocks
+
+   Claiming a slot is a compare-and-swap on queue_head, as for the log
+   ring.  Returns -1 if the queue is full; the caller keeps the batch
+   and folds more into it until it fits, nothing is dropped.
+*/
+int
+cmdq_push (const cmd_batch_t *b)
+{
+  unsigned long pos = __atomic_load_n (&queue_head, __ATOMIC_RELAXED);
+  cmd_slot_t   *slot;
+
+  while (1)
+  {
+    long diff;
+
+    slot = &queue[pos & (CMDQ_SIZE - 1)];
+    diff = (long) (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0)
+    {
+      if (__atomic_compare_exchange_n (&queue_head, &pos, pos + 1, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      return -1;
+    }
+    else
+    {
+      pos = __atomic_load_n (&queue_head, __ATOMIC_RELAXED);
+    }
+  }
+  slot->batch = *b;
+  __atomic_store_n (&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/* cmdq_pop - take the oldest batch, for the scheduler only
+
+   Returns 0 if there is none.
+*/
+int
+cmdq_pop (cmd_batch_t *b)
+{
+  cmd_slot_t *slot = &queue[queue_tail & (CMDQ_SIZE - 1)];
+
+  if (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) != queue_tail + 1)
+  {
+    return 0;
+  }
+  *b = slot->batch;
+  __atomic_store_n (&slot->seq, queue_tail + CMDQ_SIZE, __ATOMIC_RELEASE);
+  queue_tail++;
+  return 1;
+}
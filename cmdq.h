@@ -0,0 +1,44 @@
+/* File: cmdq.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Command queue of blinkd: carries rate changes from the threads
+   decoding commands to the scheduler, lock-free for any number of
+   producers and one consumer.  The change of an LED is kept as "add
+   delta, then clamp to lo..hi".  Setting, adding and resetting all
+   have this form, and so has any sequence of them, so folding many
+   commands into one change does not alter the result. */
+
+typedef struct {
+  int delta;
+  int lo;
+  int hi;
+} cmd_op_t;
+
+typedef struct {
+  cmd_op_t led[3];
+} cmd_batch_t;
+
+void cmdq_add   (cmd_batch_t *b, int led, int delta);
+int  cmdq_apply (const cmd_batch_t *b, int led, int rate);
+void cmdq_clear (cmd_batch_t *b);
+int  cmdq_empty (const cmd_batch_t *b);
+void cmdq_fold  (cmd_batch_t *b, const cmd_batch_t *later);
+int  cmdq_pop   (cmd_batch_t *b);
+int  cmdq_push  (const cmd_batch_t *b);
+void cmdq_set   (cmd_batch_t *b, int led, int rate);
+void cmdq_start (void);
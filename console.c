@@ -0,0 +1,95 @@
+/* File: console.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* The console backend sets the LEDs of the foreground tty with
+   KDSETLED.  The device is /dev/console unless given as argument. */
+
+#include <config.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/kd.h>
+#include <sys/ioctl.h>
+
+#include <backend.h>
+
+/* macros */
+#define KEYBOARDDEVICE  "/dev/console"
+#define LED_SHOW_FLAGS  0xff    /* KDSETLED: LEDs show the lock keys */
+
+/* function prototypes */
+static int  console_apply   (int mask);
+static int  console_close   (void);
+static int  console_open    (const char *arg);
+static int  console_read    (void);
+static int  console_release (void);
+
+/* global variables */
+const backend_t backend_console =
+{
+  "console", BACKEND_VT,
+  console_open, console_apply, console_read, console_close,
+  console_release, NULL, NULL, NULL
+};
+static int keyboardDevice = -1;
+
+/* console_open - open the keyboard device */
+static int
+console_open (const char *arg)
+{
+  keyboardDevice = open ((arg != NULL)? arg: KEYBOARDDEVICE,
+                         O_RDONLY | O_CLOEXEC);
+  return (keyboardDevice == -1)? -1: 0;
+}
+
+/* console_apply - set all LEDs at once */
+static int
+console_apply (int mask)
+{
+  return ioctl (keyboardDevice, KDSETLED, mask);
+}
+
+/* console_read - get the state of all LEDs */
+static int
+console_read (void)
+{
+  char ledVal;
+
+  if (ioctl (keyboardDevice, KDGETLED, &ledVal))
+  {
+    return -1;
+  }
+  return ledVal;
+}
+
+/* console_close - close the keyboard device */
+static int
+console_close (void)
+{
+  int rc = close (keyboardDevice);
+
+  keyboardDevice = -1;
+  return rc;
+}
+
+/* console_release - let the LEDs show the lock keys again */
+static int
+console_release (void)
+{
+  return ioctl (keyboardDevice, KDSETLED, LED_SHOW_FLAGS);
+}
@@ -0,0 +1,399 @@
+/* File: evdev.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* The evdev backend sends EV_LED events to every keyboard found in
+   /dev/input, so all of them blink together, each apply being one
+   write() per device.  The argument restricts the keyboards to a comma
+   separated list of device paths, e.g. from /dev/input/by-id, or of
+   parts of device names.  Keyboards plugged in later are picked up
+   through inotify and get the current state at once; keyboards that
+   are gone are dropped. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/input.h>
+#include <linux/kd.h>
+
+#include <backend.h>
+
+/* macros */
+#ifndef EVDEV_DIR
+#define EVDEV_DIR       "/dev/input"
+#endif
+#define MAX_KEYBOARDS   32
+#define NAME_SIZE       256
+#define BITS_PER_LONG   (8 * sizeof (long))
+#define TEST_BIT(b, a)  ((a)[(b) / BITS_PER_LONG] >> ((b) % BITS_PER_LONG) & 1)
+#define INOTIFY_BUFSIZE (16 * (sizeof (struct inotify_event) + NAME_MAX + 1))
+
+/* type definitions */
+typedef struct {
+  int  fd;
+  int  initial;                 /* state before blinkd */
+  char node[NAME_SIZE];         /* name in EVDEV_DIR */
+} keyboard_t;
+
+/* function prototypes */
+static int  add_keyboard    (const char *node);
+static int  evdev_apply     (int mask);
+static int  evdev_close     (void);
+static int  evdev_hotplug   (void);
+static int  evdev_open      (const char *arg);
+static int  evdev_read      (void);
+static int  evdev_release   (void);
+static int  evdev_watch     (void);
+static int  read_leds       (int fd);
+static void remove_keyboard (int i);
+static int  selected        (const char *path, int fd);
+static int  write_leds      (int fd, int mask, int which);
+
+/* global variables */
+const backend_t backend_evdev =
+{
+  "evdev", 0,
+  evdev_open, evdev_apply, evdev_read, evdev_close, evdev_release,
+  evdev_watch, evdev_hotplug, NULL
+};
+static const struct {
+  int code;                     /* EV_LED code */
+  int bit;                      /* KDSETLED bit */
+} led_map[3] = { {LED_CAPSL, LED_CAP}, {LED_NUML, LED_NUM},
+                 {LED_SCROLLL, LED_SCR} };
+static keyboard_t   keyboards[MAX_KEYBOARDS];
+static int          nkeyboards = 0;
+static keyboard_t   closed[MAX_KEYBOARDS]; /* as before evdev_close */
+static int          nclosed    = 0;
+static int          inotifyfd  = -1;
+static int          current    = 0;
+static int          touched    = 0; /* LEDs ever changed by blinkd */
+static const char  *filter     = NULL; /* the argument */
+
+/* evdev_open - watch EVDEV_DIR and open all keyboards in it
+
+   Having no keyboard yet is fine, it may be plugged in later.
+*/
+static int
+evdev_open (const char *arg)
+{
+  DIR           *dir;
+  struct dirent *de;
+
+  filter = arg;               /* touched is kept over reopening */
+  if ((inotifyfd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) == -1)
+  {
+    return -1;
+  }
+  /* udev makes new nodes accessible only after creating them */
+  if (inotify_add_watch (inotifyfd, EVDEV_DIR,
+                         IN_CREATE | IN_ATTRIB | IN_DELETE) == -1 ||
+      (dir = opendir (EVDEV_DIR)) == NULL)
+  {
+    evdev_close ();
+    return -1;
+  }
+  while ((de = readdir (dir)) != NULL)
+  {
+    add_keyboard (de->d_name);
+  }
+  closedir (dir);
+  return 0;
+}
+
+/* add_keyboard - open an event device, if it is a selected keyboard */
+static int
+add_keyboard (const char *node)
+{
+  unsigned long bits[EV_MAX / (8 * sizeof (long)) + 1];
+  keyboard_t   *kb;
+  char          path[NAME_SIZE + sizeof (EVDEV_DIR)];
+  int           i, fd;
+
+  if (strncmp (node, "event", 5) || strlen (node) >= NAME_SIZE ||
+      nkeyboards == MAX_KEYBOARDS)
+  {
+    return -1;
+  }
+  for (i = 0; i < nkeyboards; i++)
+  {
+    if (!strcmp (keyboards[i].node, node))
+    {
+      return -1;                /* already open */
+    }
+  }
+  sprintf (path, EVDEV_DIR "/%s", node);
+  if ((fd = open (path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1)
+  {
+    return -1;
+  }
+  memset (bits, 0, sizeof (bits));
+  if (ioctl (fd, EVIOCGBIT (0, sizeof (bits)), bits) == -1 ||
+      !TEST_BIT (EV_LED, bits) ||
+      ioctl (fd, EVIOCGBIT (EV_LED, sizeof (bits)), bits) == -1 ||
+      !(TEST_BIT (LED_CAPSL, bits) || TEST_BIT (LED_NUML, bits) ||
+        TEST_BIT (LED_SCROLLL, bits)) ||
+      !selected (path, fd))
+  {
+    close (fd);
+    return -1;
+  }
+  kb          = &keyboards[nkeyboards++];
+  kb->fd      = fd;
+  kb->initial = read_leds (fd);
+  strcpy (kb->node, node);
+  for (i = 0; i < nclosed; i++)
+  {
+    if (!strcmp (closed[i].node, node))
+    {
+      kb->initial = closed[i].initial; /* not what blinkd left */
+    }
+  }
+  write_leds (fd, current, touched); /* join the others */
+  return 0;
+}
+
+/* selected - check a keyboard against the argument, if any
+
+   Device paths are compared by the device they point to.
+*/
+static int
+selected (const char *path,
+          int fd)
+{
+  const char *p = filter;
+  char        name[NAME_SIZE], entry[NAME_SIZE], real[PATH_MAX];
+  char        target[PATH_MAX];
+
+  if (filter == NULL)
+  {
+    return 1;
+  }
+  if (ioctl (fd, EVIOCGNAME (sizeof (name)), name) == -1)
+  {
+    name[0] = '\0';
+  }
+  name[sizeof (name) - 1] = '\0';
+  if (realpath (path, real) == NULL)
+  {
+    return 0;
+  }
+  while (*p)
+  {
+    size_t len = strcspn (p, ",");
+
+    if (len && len < sizeof (entry))
+    {
+      memcpy (entry, p, len);
+      entry[len] = '\0';
+      if ((*entry == '/')?
+          (realpath (entry, target) != NULL && !strcmp (target, real)):
+          (strstr (name, entry) != NULL))
+      {
+        return 1;
+      }
+    }
+    p += len + (p[len] == ',');
+  }
+  return 0;
+}
+
+/* evdev_apply - set the LEDs of all keyboards
+
+   Only the LEDs that change are written, so every keyboard keeps its
+   own state of the LEDs not in use.
+*/
+static int
+evdev_apply (int mask)
+{
+  int i, changed = mask ^ current;
+
+  current  = mask;
+  touched |= changed;
+  for (i = 0; i < nkeyboards; i++)
+  {
+    if (write_leds (keyboards[i].fd, mask, changed) && errno == ENODEV)
+    {
+      remove_keyboard (i--);    /* unplugged, inotify may be late */
+    }
+  }
+  return 0;
+}
+
+/* write_leds - send the events for the LEDs in which and a report
+
+   All of them go with one write().
+*/
+static int
+write_leds (int fd,
+            int mask,
+            int which)
+{
+  struct input_event ev[4];
+  size_t             n = 0;
+  int                i;
+
+  memset (ev, 0, sizeof (ev));
+  for (i = 0; i < 3; i++)
+  {
+    if (which & led_map[i].bit)
+    {
+      ev[n].type    = EV_LED;
+      ev[n].code    = led_map[i].code;
+      ev[n++].value = (mask & led_map[i].bit) != 0;
+    }
+  }
+  if (!n)
+  {
+    return 0;
+  }
+  ev[n].type = EV_SYN;
+  ev[n].code = SYN_REPORT;
+  n++;
+  return (write (fd, ev, n * sizeof (*ev)) == (ssize_t) (n * sizeof (*ev)))?
+         0: -1;
+}
+
+/* evdev_read - the state of the first keyboard stands for all */
+static int
+evdev_read (void)
+{
+  return current = nkeyboards? read_leds (keyboards[0].fd): current;
+}
+
+/* read_leds - get the LEDs of one keyboard as KDSETLED mask */
+static int
+read_leds (int fd)
+{
+  unsigned long bits[LED_MAX / (8 * sizeof (long)) + 1];
+  int           i, mask = 0;
+
+  memset (bits, 0, sizeof (bits));
+  if (ioctl (fd, EVIOCGLED (sizeof (bits)), bits) == -1)
+  {
+    return 0;
+  }
+  for (i = 0; i < 3; i++)
+  {
+    if (TEST_BIT (led_map[i].code, bits))
+    {
+      mask |= led_map[i].bit;
+    }
+  }
+  return mask;
+}
+
+/* evdev_watch - the inotify fd tells about keyboards coming and going */
+static int
+evdev_watch (void)
+{
+  return inotifyfd;
+}
+
+/* evdev_hotplug - add and remove keyboards as reported by inotify */
+static int
+evdev_hotplug (void)
+{
+  char    buf[INOTIFY_BUFSIZE];
+  ssize_t rr;
+
+  while ((rr = read (inotifyfd, buf, sizeof (buf))) > 0)
+  {
+    char *p = buf;
+
+    while (p < buf + rr)
+    {
+      struct inotify_event *ev = (struct inotify_event *) p;
+      int                   i;
+
+      if (ev->mask & IN_DELETE)
+      {
+        for (i = 0; i < nkeyboards; i++)
+        {
+          if (!strcmp (keyboards[i].node, ev->name))
+          {
+            remove_keyboard (i);
+            break;
+          }
+        }
+      }
+      else if (ev->len)
+      {
+        add_keyboard (ev->name);
+      }
+      p += sizeof (*ev) + ev->len;
+    }
+  }
+  return (rr == -1 && errno != EAGAIN)? -1: 0;
+}
+
+/* remove_keyboard - close a keyboard and forget it */
+static void
+remove_keyboard (int i)
+{
+  close (keyboards[i].fd);      /* ignore any errors */
+  keyboards[i] = keyboards[--nkeyboards];
+}
+
+/* evdev_close - close all keyboards and stop watching
+
+   Their states before blinkd are kept for reopening them.
+*/
+static int
+evdev_close (void)
+{
+  if (nkeyboards)               /* not for a failed reopen */
+  {
+    memcpy (closed, keyboards, nkeyboards * sizeof (keyboard_t));
+    nclosed = nkeyboards;
+  }
+  while (nkeyboards)
+  {
+    remove_keyboard (0);
+  }
+  if (inotifyfd != -1)
+  {
+    close (inotifyfd);
+    inotifyfd = -1;
+  }
+  return 0;
+}
+
+/* evdev_release - give every keyboard its own state back */
+static int
+evdev_release (void)
+{
+  int i, rc = 0;
+
+  for (i = 0; i < nkeyboards; i++)
+  {
+    if (write_leds (keyboards[i].fd, keyboards[i].initial, touched))
+    {
+      rc = -1;
+    }
+  }
+  return rc;
+}
@@ -53,8 +53,11 @@ if { "$vbox_flag_record" == "TRUE" } {
     # Scroll-Lock LED with blinkd.
     ## set number_msgs [ vbox_get_nr_new_messages $vbox_var_spooldir/incoming ]
     ## exec -- /usr/bin/blink --numlockled --rate=$number_msgs
-    # The other way is the easy one:
-    exec -- /usr/bin/blink --numlockled --rate=+
+    # The other way is the easy one, sent as a datagram so that vbox
+    # never has to wait for blinkd:
+    exec -- /usr/bin/blink --datagram --numlockled --rate=+
+    # Or let blinkd count the messages itself, started with
+    # --watch=num:/var/spool/vbox/<user>/incoming, and drop this line.
 
    if { "$RC" == "HANGUP" } {
       return
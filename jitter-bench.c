@@ -0,0 +1,354 @@
+/* File: jitter-bench.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Benchmark of the blink timing of blinkd.  Reads the edges the mock
+   backend writes with "blinkd --backend=mock:file", for an LED that
+   blinked the count pattern at one rate from 0 on, and compares every
+   edge with the time the pattern gives it, counted from the first
+   one.  As no edge can come early, the errors are then taken relative
+   to the earliest edge.  Reports percentiles of the error in
+   microseconds and the error of the last edge, which grows with any
+   drift; bench.sh runs
+   it idle and under CPU and network load.  Results are "name value"
+   lines or one JSON object. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <linux/kd.h>
+
+#include <pattern.h>
+
+/* macros */
+#define EDGES_MAX       65536   /* as many as the mock backend keeps */
+#define LINE_MAX_LEN    64
+
+/* function prototypes */
+static int  cmp_long     (const void *, const void *);
+static void compare      (const pattern_t *, FILE *);
+static long next_change  (const pattern_t *, pat_pos_t *, int);
+static long percentile   (const long *, size_t, int);
+static void process_opts (int, char **);
+static void report       (void);
+static void usage        (char *);
+static void wrong_use    (char *);
+
+/* global variables */
+static const char *led_names[] = {"caps", "num", "scroll"};
+static const int   led_bits[]  = {LED_CAP, LED_NUM, LED_SCR};
+static int         led         = 0;      /* index of led_names */
+static int         rate        = 3;
+static int         on_ms       = 200;
+static int         off_ms      = 200;
+static int         pause_ms    = 600;
+static int         json        = 0;
+static const char *path        = NULL;
+static long        errors[EDGES_MAX]; /* in us, late is positive */
+static size_t      nerrors     = 0;
+static long        last_error  = 0;
+static unsigned long missed    = 0;
+
+/* main - compare the edges of the file with the pattern */
+int
+main (int argc,
+      char **argv)
+{
+  const pattern_t *count;
+  FILE            *f;
+
+  process_opts (argc, argv);
+  if ((count = pattern_count (on_ms, off_ms, pause_ms)) == NULL)
+  {
+    fprintf (stderr, "Out of memory.\n");
+    exit (EXIT_FAILURE);
+  }
+  if ((f = fopen (path, "r")) == NULL)
+  {
+    perror (path);
+    exit (EXIT_FAILURE);
+  }
+  compare (count, f);
+  fclose (f);
+  if (!nerrors)
+  {
+    fprintf (stderr, "%s: no edges to compare.\n", path);
+    exit (EXIT_FAILURE);
+  }
+  report ();
+  return EXIT_SUCCESS;
+}
+
+/* compare - record the error of every edge of the LED
+
+   An edge nearer to a later change of the pattern than to the next
+   one means changes were lost, they are counted as missed.
+*/
+static void
+compare (const pattern_t *count,
+         FILE *f)
+{
+  char      line[LINE_MAX_LEN];
+  pat_pos_t pos;
+  long      first = -1;         /* us of the first edge */
+  long      due   = 0;          /* ms since then the edge is due at */
+  int       lit   = 0;
+
+  pattern_start (&pos, rate);
+  while (fgets (line, sizeof (line), f) != NULL && nerrors < EDGES_MAX)
+  {
+    long      sec, nsec, elapsed_us;
+    int       mask, panel;
+    pat_pos_t later;
+    long      later_due;
+
+    if (sscanf (line, "%ld.%ld %d %d", &sec, &nsec, &mask, &panel) != 3 ||
+        !(mask & led_bits[led]) == !lit)
+    {
+      continue;                 /* a panel LED or another LED */
+    }
+    lit = !lit;
+    if (first == -1)            /* the pattern starts lit */
+    {
+      first = sec * 1000000L + nsec / 1000;
+      continue;
+    }
+    elapsed_us = sec * 1000000L + nsec / 1000 - first;
+    due += next_change (count, &pos, lit);
+    while (1)
+    {
+      later     = pos;
+      later_due = due + next_change (count, &later, !lit);
+      later_due += next_change (count, &later, lit);
+      if (elapsed_us - due * 1000 <= later_due * 1000 - elapsed_us)
+      {
+        break;
+      }
+      pos     = later;
+      due     = later_due;
+      missed += 2;
+    }
+    last_error        = elapsed_us - due * 1000;
+    errors[nerrors++] = last_error;
+  }
+}
+
+/* next_change - walk the pattern to the next step with the LED lit as
+   given, return the ms until then */
+static long
+next_change (const pattern_t *count,
+             pat_pos_t *pos,
+             int lit)
+{
+  long ms = 0;
+
+  do
+  {
+    ms += count->steps[pos->step].ms;
+    pattern_next (count, pos, rate);
+  }
+  while (!(count->steps[pos->step].lit & PAT_SELF) != !lit);
+  return ms;
+}
+
+/* report - print the percentiles of the errors */
+static void
+report (void)
+{
+  size_t i;
+
+  qsort (errors, nerrors, sizeof (*errors), cmp_long);
+  last_error -= errors[0];
+  for (i = nerrors; i-- > 0; )
+  {
+    errors[i] -= errors[0];
+  }
+  if (json)
+  {
+    printf ("{\"led\": \"%s\", \"rate\": %d, \"on_ms\": %d, "
+            "\"off_ms\": %d, \"pause_ms\": %d, \"edges\": %lu, "
+            "\"missed\": %lu, \"p50_us\": %ld, \"p90_us\": %ld, "
+            "\"p99_us\": %ld, \"p999_us\": %ld, \"max_us\": %ld, "
+            "\"last_us\": %ld}\n",
+            led_names[led], rate, on_ms, off_ms, pause_ms,
+            (unsigned long) nerrors, missed,
+            percentile (errors, nerrors, 500),
+            percentile (errors, nerrors, 900),
+            percentile (errors, nerrors, 990),
+            percentile (errors, nerrors, 999), errors[nerrors - 1],
+            last_error);
+  }
+  else
+  {
+    printf ("edges %lu\n"
+            "missed %lu\n"
+            "p50_us %ld\n"
+            "p90_us %ld\n"
+            "p99_us %ld\n"
+            "p999_us %ld\n"
+            "max_us %ld\n"
+            "last_us %ld\n",
+            (unsigned long) nerrors, missed,
+            percentile (errors, nerrors, 500),
+            percentile (errors, nerrors, 900),
+            percentile (errors, nerrors, 990),
+            percentile (errors, nerrors, 999), errors[nerrors - 1],
+            last_error);
+  }
+}
+
+/* percentile - of n sorted values, in permille */
+static long
+percentile (const long *v,
+            size_t n,
+            int permille)
+{
+  size_t i = (size_t) ((double) n * permille / 1000);
+
+  return v[(i < n)? i: n - 1];
+}
+
+/* cmp_long - qsort helper */
+static int
+cmp_long (const void *a,
+          const void *b)
+{
+  long x = *(const long *) a;
+  long y = *(const long *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* process_opts - process command line, see function usage() for options */
+static void
+process_opts (int argc,
+              char **argv)
+{
+  int   c = 0;
+  char *end;
+
+  while (1)
+  {
+    int option_index                    = 0;
+    static struct option long_options[] =
+    {
+      {"help",          0, 0, 'h'},
+      {"json",          0, 0, 'j'},
+      {"led",           1, 0, 'l'},
+      {"off-time",      1, 0, 'f'},
+      {"on-time",       1, 0, 'o'},
+      {"pause",         1, 0, 'p'},
+      {"rate",          1, 0, 'r'},
+      {"version",       0, 0, 'v'},
+      {0,               0, 0, 0}
+    };
+    c = getopt_long (argc, argv, "f:hjl:o:p:r:v", long_options,
+                     &option_index);
+    if (c == -1)
+    {
+      break;
+    }
+    switch (c)
+    {
+      case 'f':
+        if ((off_ms = pattern_time (optarg, &end)) == -1 || *end)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'h':
+        usage (argv[0]);
+        exit (EXIT_SUCCESS);
+      case 'j':
+        json = 1;
+        break;
+      case 'l':
+        for (c = 0; c < 3; c++)
+        {
+          if (!strcmp (optarg, led_names[c]))
+          {
+            break;
+          }
+        }
+        if (c == 3)
+        {
+          wrong_use (argv[0]);
+        }
+        led = c;
+        break;
+      case 'o':
+        if ((on_ms = pattern_time (optarg, &end)) == -1 || *end)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'p':
+        if ((pause_ms = pattern_time (optarg, &end)) == -1 || *end)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'r':
+        if ((rate = atoi (optarg)) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'v':
+        printf ("jitter-bench (%s) %s\n", PACKAGE, VERSION);
+        exit (EXIT_SUCCESS);
+      default:
+        wrong_use (argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+  {
+    wrong_use (argv[0]);
+  }
+  path = argv[optind];
+}
+
+/* usage - help on options */
+static void
+usage (char* name)
+{
+  printf ("Usage: %s [options] edges\n"
+          "Options are\n"
+          "  -f t, --off-time=t    off time of blinkd (2)\n"
+          "  -h,   --help          display this help and exit\n"
+          "  -j,   --json          print the results as JSON\n"
+          "  -l l, --led=l         compare LED caps, num or scroll (caps)\n"
+          "  -o t, --on-time=t     on time of blinkd (2)\n",
+          name);
+  fputs ("  -p t, --pause=t       pause time of blinkd (6)\n"
+         "  -r n, --rate=n        rate the LED blinked at (3)\n"
+         "  -v,   --version       output version information and exit\n"
+         "Times t are given as for blinkd, in tenths of a second or\n"
+         "with unit ms or s.\n",
+         stdout);
+}
+
+/* wrong_use - output for the user, if options cannot be interpreted */
+static void
+wrong_use (char *name)
+{
+  fprintf (stderr, "%s: Error in arguments.  Try %s --help.\n", name, name);
+  exit (EXIT_FAILURE);
+}
@@ -0,0 +1,1015 @@
+/* File: libblink.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include <blinkd.h>
+#include <libblink.h>
+#include <ringpush.h>
+
+/* macros */
+#define OPS_MAX         (BLINKD_FRAME_MAX / 4) /* commands per frame */
+#define OUT_MAX         65536   /* octets buffered while not sent */
+#define V1_RATE_MAX     (RATE_INC - 1)
+#define V1_DELTA_MAX    1024    /* RATE_INC/RATE_DEC octets per command */
+#define V1_DELTA_FIT    4       /* as v1 only if no longer than in v2 */
+#define DELTA_MAX       0x7fff
+#define REPLY_TIMEOUT   5000    /* ms to wait for statistics */
+#define STATE_TRIES     1000    /* reads of a state being written */
+#define RING_RETRY_NS   100000  /* wait for room in a full ring */
+
+/* type definitions */
+typedef struct {
+  int op;                       /* BLINKD_OP_SET, _ADD or _RESET */
+  int led;
+  int value;
+} op_t;
+
+struct blink_s {
+  int           fd;
+  int           flags;
+  int           connecting;     /* non-blocking connect in progress */
+  int           proto;          /* of the connection, 0 until used */
+  char         *host;
+  int           port;
+  char         *path;
+  op_t          ops[OPS_MAX];   /* queued, not encoded yet */
+  int           nops;
+  int           last[3];        /* latest op of each LED, or -1 */
+  unsigned char out[OUT_MAX];   /* encoded, not sent yet */
+  size_t        out_len;
+  size_t        out_sent;       /* of the first frame */
+  ringpush_t    ring;           /* with BLINK_RING, once mapped */
+};
+
+struct blink_state_s {
+  const blinkd_state_t *shm;
+};
+
+/* function prototypes */
+static int    check_connect   (blink_t *b);
+static int    connect_server  (blink_t *b);
+static int    connect_unix    (const char *path, int type);
+static void   drop_connection (blink_t *b);
+static int    encode          (blink_t *b);
+static int    fits_v1         (const blink_t *b);
+static int    flush_ring      (blink_t *b);
+static int    queue_op        (blink_t *b, int op, int led, int value);
+static int    read_reply      (blink_t *b, unsigned char *buf, size_t len,
+                               int text);
+static size_t unit_size       (const blink_t *b);
+static int    wait_fd         (blink_t *b, short events);
+
+/* blink_open - create a handle and connect to blinkd
+
+   Without BLINK_NONBLOCK a failing connect is an error, with it the
+   connect is retried by blink_flush().
+*/
+blink_t *
+blink_open (const char *host,
+            int port,
+            const char *path,
+            int flags)
+{
+  blink_t *b;
+  int      i;
+
+  if ((b = calloc (1, sizeof (*b))) == NULL)
+  {
+    return NULL;
+  }
+  b->fd    = -1;
+  b->flags = flags;
+  b->port  = port;
+  if ((host != NULL && (b->host = strdup (host)) == NULL) ||
+      (path != NULL && (b->path = strdup (path)) == NULL))
+  {
+    blink_close (b);
+    errno = ENOMEM;
+    return NULL;
+  }
+  for (i = BLINK_CAP; i < BLINK_ALL; i++)
+  {
+    b->last[i] = -1;
+  }
+  if (((flags & BLINK_RING)? ringpush_map (&b->ring, b->path):
+       connect_server (b)) == -1 &&
+      !(flags & BLINK_NONBLOCK))
+  {
+    int saved = errno;
+
+    blink_close (b);
+    errno = saved;
+    return NULL;
+  }
+  return b;
+}
+
+/* blink_close - send what is queued, unless that would wait, and close */
+void
+blink_close (blink_t *b)
+{
+  if ((b->fd != -1 || b->ring.ring != NULL) &&
+      !(b->flags & BLINK_NONBLOCK))
+  {
+    blink_flush (b);
+  }
+  if (b->fd != -1)
+  {
+    close (b->fd);
+  }
+  ringpush_unmap (&b->ring);
+  free (b->host);
+  free (b->path);
+  free (b);
+}
+
+/* blink_set - queue setting the rate of an LED, or of all of them */
+int
+blink_set (blink_t *b,
+           blink_led_t led,
+           int rate)
+{
+  if (rate < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  return queue_op (b, BLINKD_OP_SET, led,
+                   (rate > BLINKD_RATE_MAX)? BLINKD_RATE_MAX: rate);
+}
+
+/* blink_add - queue changing the rate of an LED by delta */
+int
+blink_add (blink_t *b,
+           blink_led_t led,
+           int delta)
+{
+  while (delta > DELTA_MAX || delta < -DELTA_MAX)
+  {
+    int part = (delta > 0)? DELTA_MAX: -DELTA_MAX;
+
+    if (queue_op (b, BLINKD_OP_ADD, led, part) == -1)
+    {
+      return -1;
+    }
+    delta -= part;
+  }
+  return delta? queue_op (b, BLINKD_OP_ADD, led, delta): 0;
+}
+
+/* blink_reset - queue setting all rates to 0 */
+int
+blink_reset (blink_t *b)
+{
+  return queue_op (b, BLINKD_OP_RESET, BLINK_ALL, 0);
+}
+
+/* queue_op - queue a command, merging it with the one before
+
+   Merging never changes the effect: a rate set later wins, a delta
+   adds to a rate set before, and deltas of the same sign add up.
+   Deltas of different signs do not, as rates stop at 0.
+*/
+static int
+queue_op (blink_t *b,
+          int op,
+          int led,
+          int value)
+{
+  op_t *o;
+  int   i;
+
+  if (led < BLINK_CAP || led > BLINK_ALL)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  if (op == BLINKD_OP_RESET)    /* nothing before matters any more */
+  {
+    b->nops = 0;
+    for (i = BLINK_CAP; i < BLINK_ALL; i++)
+    {
+      b->last[i] = -1;
+    }
+  }
+  else if (led == BLINK_ALL)
+  {
+    for (i = BLINK_CAP; i < BLINK_ALL; i++)
+    {
+      if (queue_op (b, op, i, value) == -1)
+      {
+        return -1;
+      }
+    }
+    return 0;
+  }
+  else if (b->last[led] != -1)
+  {
+    o = &b->ops[b->last[led]];
+    if (op == BLINKD_OP_SET)
+    {
+      o->op    = BLINKD_OP_SET;
+      o->value = value;
+      return 0;
+    }
+    if (o->op == BLINKD_OP_SET)
+    {
+      o->value += value;
+      o->value  = (o->value < 0)? 0:
+                  (o->value > BLINKD_RATE_MAX)? BLINKD_RATE_MAX: o->value;
+      return 0;
+    }
+    if ((o->value < 0) == (value < 0) &&
+        o->value + value <= DELTA_MAX && o->value + value >= -DELTA_MAX)
+    {
+      o->value += value;
+      return 0;
+    }
+  }
+  if (b->nops == OPS_MAX && encode (b) == -1)
+  {
+    return -1;
+  }
+  o        = &b->ops[b->nops];
+  o->op    = op;
+  o->led   = led;
+  o->value = value;
+  if (op != BLINKD_OP_RESET)
+  {
+    b->last[led] = b->nops;
+  }
+  b->nops++;
+  return 0;
+}
+
+/* encode - move the queued commands to the output buffer
+
+   Protocol v2 puts them into frames, small enough for a datagram if
+   need be; v1 uses one octet per command.  Commands v1 can express
+   go as v1, so blinkd 0.4.8 and older understand them, unless the
+   connection speaks v2 already.
+*/
+static int
+encode (blink_t *b)
+{
+  size_t max = (b->flags & BLINK_RING)?
+               BLINKD_RING_DATA - BLINKD_HDR_SIZE:
+               (b->flags & BLINK_DATAGRAM)?
+               BLINKD_DGRAM_MAX - BLINKD_HDR_SIZE: BLINKD_FRAME_MAX;
+  size_t need = 0, frame = (size_t) -1;
+  int    i, v1;
+
+  v1 = b->flags & BLINK_V1 || (b->proto != 2 && fits_v1 (b));
+  for (i = 0; i < b->nops; i++)
+  {
+    op_t *o = &b->ops[i];
+
+    if (v1)
+    {
+      need += (o->op != BLINKD_OP_ADD)? 1:
+              (o->value > V1_DELTA_MAX || o->value < -V1_DELTA_MAX)?
+              V1_DELTA_MAX: abs (o->value);
+    }
+    else
+    {
+      need += (o->op == BLINKD_OP_RESET)? 1: 4;
+    }
+  }
+  if (!v1)                      /* headers, at least 1 in max octets */
+  {
+    need += (need / (max - 3) + 1) * BLINKD_HDR_SIZE;
+  }
+  if (b->out_len + need > sizeof (b->out))
+  {
+    errno = ENOBUFS;
+    return -1;
+  }
+  for (i = 0; i < b->nops; i++)
+  {
+    op_t          *o = &b->ops[i];
+    unsigned char *p = b->out + b->out_len;
+
+    if (v1)
+    {
+      int n = abs (o->value);
+
+      if (o->op == BLINKD_OP_RESET)
+      {
+        *p++ = BLINKD_ALL << 6;
+      }
+      else if (o->op == BLINKD_OP_SET)
+      {
+        *p++ = (o->led << 6) | ((o->value > V1_RATE_MAX)?
+                                V1_RATE_MAX: o->value);
+      }
+      else
+      {
+        for (n = (n > V1_DELTA_MAX)? V1_DELTA_MAX: n; n; n--)
+        {
+          *p++ = (o->led << 6) | ((o->value > 0)? RATE_INC: RATE_DEC);
+        }
+      }
+      b->out_len = p - b->out;
+      continue;
+    }
+    if (frame == (size_t) -1 || b->out_len - frame + 4 > max + BLINKD_HDR_SIZE)
+    {
+      frame  = b->out_len;      /* start a new frame */
+      p[0]   = BLINKD_V2;
+      p[1]   = 0;
+      p     += BLINKD_HDR_SIZE;
+    }
+    *p++ = o->op;
+    if (o->op != BLINKD_OP_RESET)
+    {
+      *p++ = o->led;
+      *p++ = (o->value >> 8) & 0xff;
+      *p++ = o->value & 0xff;
+    }
+    b->out_len = p - b->out;
+    b->out[frame + 2] = (b->out_len - frame - BLINKD_HDR_SIZE) >> 8;
+    b->out[frame + 3] = (b->out_len - frame - BLINKD_HDR_SIZE) & 0xff;
+  }
+  b->nops = 0;
+  for (i = BLINK_CAP; i < BLINK_ALL; i++)
+  {
+    b->last[i] = -1;
+  }
+  return 0;
+}
+
+/* fits_v1 - can v1 express the queued commands without a change?
+
+   A delta costs an octet per step in v1, larger ones go as v2.
+*/
+static int
+fits_v1 (const blink_t *b)
+{
+  int i;
+
+  for (i = 0; i < b->nops; i++)
+  {
+    const op_t *o = &b->ops[i];
+
+    if ((o->op == BLINKD_OP_SET && o->value > V1_RATE_MAX) ||
+        (o->op == BLINKD_OP_ADD && abs (o->value) > V1_DELTA_FIT))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* blink_flush - send everything queued
+
+   Returns 1 if a non-blocking handle could not send it all yet.  A lost
+   connection is made again once, frames sent only partly are sent
+   again completely.
+*/
+int
+blink_flush (blink_t *b)
+{
+  int retried = 0;
+
+  if (encode (b) == -1)
+  {
+    return -1;
+  }
+  if (b->flags & BLINK_RING)
+  {
+    return flush_ring (b);
+  }
+  while (b->out_len)
+  {
+    size_t  n;
+    ssize_t sent;
+    int     proto = (b->out[0] == BLINKD_V2)? 2: 1;
+
+    /* blinkd takes the protocol of a connection from its first octet */
+    if (b->fd != -1 && !(b->flags & BLINK_DATAGRAM) && !b->out_sent &&
+        b->proto && b->proto != proto)
+    {
+      drop_connection (b);
+    }
+    if (b->fd == -1 && connect_server (b) == -1)
+    {
+      return -1;
+    }
+    if (b->connecting && check_connect (b))
+    {
+      return (b->connecting)? 1: -1;
+    }
+    if (!(b->flags & BLINK_DATAGRAM))
+    {
+      b->proto = proto;
+    }
+    n = unit_size (b);
+    if ((sent = send (b->fd, b->out + b->out_sent, n - b->out_sent,
+                      MSG_NOSIGNAL)) == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        return 1;
+      }
+      drop_connection (b);
+      if (retried++ || b->flags & BLINK_DATAGRAM)
+      {
+        return -1;
+      }
+      continue;
+    }
+    b->out_sent += sent;
+    if (proto == 1 && !(b->flags & BLINK_DATAGRAM))
+    {
+      n = b->out_sent;          /* every octet is a command of its own */
+      memmove (b->out, b->out + n, b->out_len - n);
+      b->out_len -= n;
+      b->out_sent = 0;
+    }
+    while (b->out_len && b->out_sent >= (n = unit_size (b)))
+    {
+      memmove (b->out, b->out + n, b->out_len - n);
+      b->out_len  -= n;
+      b->out_sent -= n;
+    }
+  }
+  return 0;
+}
+
+/* unit_size - octets at the start of the buffer that belong together
+
+   A v2 frame, or the v1 octets up to the next frame, for datagrams
+   only as many as fit into one.  No v1 octet is BLINKD_V2.
+*/
+static size_t
+unit_size (const blink_t *b)
+{
+  const unsigned char *frame;
+  size_t               n;
+
+  if (b->out[0] == BLINKD_V2)
+  {
+    return BLINKD_HDR_SIZE + ((b->out[2] << 8) | b->out[3]);
+  }
+  frame = memchr (b->out, BLINKD_V2, b->out_len);
+  n     = (frame != NULL)? (size_t) (frame - b->out): b->out_len;
+  if (b->flags & BLINK_RING && n > BLINKD_RING_DATA)
+  {
+    return BLINKD_RING_DATA;
+  }
+  if (b->flags & BLINK_DATAGRAM && n > BLINKD_DGRAM_MAX)
+  {
+    return BLINKD_DGRAM_MAX;
+  }
+  return n;
+}
+
+/* flush_ring - push the encoded commands into the ring, a record per
+   unit
+
+   A full ring is waited for, up to the reply timeout, unless the
+   handle is non-blocking.
+*/
+static int
+flush_ring (blink_t *b)
+{
+  struct timespec retry;
+  long            waited = 0;
+
+  retry.tv_sec  = 0;
+  retry.tv_nsec = RING_RETRY_NS;
+  while (b->out_len)
+  {
+    size_t n;
+
+    if (b->ring.ring == NULL && ringpush_map (&b->ring, b->path) == -1)
+    {
+      return -1;
+    }
+    n = unit_size (b);
+    if (ringpush_push (&b->ring, b->out, n) == -1)
+    {
+      if (b->flags & BLINK_NONBLOCK)
+      {
+        return 1;
+      }
+      if ((waited += RING_RETRY_NS) > REPLY_TIMEOUT * 1000000L)
+      {
+        errno = ETIMEDOUT;
+        return -1;
+      }
+      nanosleep (&retry, NULL);
+      continue;
+    }
+    memmove (b->out, b->out + n, b->out_len - n);
+    b->out_len -= n;
+  }
+  return 0;
+}
+
+/* blink_fd - the socket to poll, -1 while not connected */
+int
+blink_fd (const blink_t *b)
+{
+  return b->fd;
+}
+
+/* blink_events - what to poll for: hangups, and room for pending data */
+int
+blink_events (const blink_t *b)
+{
+  int events = 0;
+
+  if (b->fd == -1)
+  {
+    return 0;
+  }
+  if (!(b->flags & BLINK_DATAGRAM))
+  {
+    events |= POLLIN;
+  }
+  if (b->connecting || b->out_len || b->nops)
+  {
+    events |= POLLOUT;
+  }
+  return events;
+}
+
+/* blink_handle - continue after poll() reported revents for blink_fd()
+
+   Returns as blink_flush().
+*/
+int
+blink_handle (blink_t *b,
+              int revents)
+{
+  if (b->fd != -1 && !(b->flags & BLINK_DATAGRAM) &&
+      revents & (POLLIN | POLLHUP | POLLERR))
+  {
+    unsigned char buf[256];
+    ssize_t       rr;
+
+    /* nothing is expected, so this is mostly the end of file */
+    while ((rr = recv (b->fd, buf, sizeof (buf), MSG_DONTWAIT)) > 0)
+    {
+    }
+    if (rr == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                    errno != EINTR))
+    {
+      drop_connection (b);
+    }
+  }
+  if (b->out_len || b->nops || b->connecting)
+  {
+    return blink_flush (b);
+  }
+  return 0;
+}
+
+/* blink_stats - ask blinkd for its statistics, waits for the reply
+
+   Returns the length of the text stored in buf.
+*/
+int
+blink_stats (blink_t *b,
+             char *buf,
+             size_t len)
+{
+  unsigned char query[BLINKD_HDR_SIZE + 2];
+  int           rc, v1;
+
+  if (b->flags & (BLINK_DATAGRAM | BLINK_RING) || !len)
+  {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  while ((rc = blink_flush (b)) == 1)
+  {
+    if (wait_fd (b, POLLOUT) == -1)
+    {
+      return -1;
+    }
+  }
+  if (rc == -1)
+  {
+    return -1;
+  }
+  /* a connection speaking v1 already asks in v1 */
+  v1       = b->flags & BLINK_V1 || b->proto == 1;
+  query[0] = BLINKD_QUERY_STATS;
+  if (!v1)
+  {
+    query[0] = BLINKD_V2;
+    query[1] = 0;
+    query[2] = 0;
+    query[3] = 2;
+    query[4] = BLINKD_OP_QUERY;
+    query[5] = BLINKD_Q_STATS;
+  }
+  memcpy (b->out, query, b->out_len = v1? 1: sizeof (query));
+  while ((rc = blink_flush (b)) == 1)
+  {
+    if (wait_fd (b, POLLOUT) == -1)
+    {
+      return -1;
+    }
+  }
+  if (rc == -1)
+  {
+    return -1;
+  }
+  return read_reply (b, (unsigned char *) buf, len, v1);
+}
+
+/* blink_state_open - map the LED state blinkd publishes
+
+   name NULL is the default shared memory object.  Fails with EPROTO
+   for a layout this library does not know.
+*/
+blink_state_t *
+blink_state_open (const char *name)
+{
+  blink_state_t *s;
+  struct stat    st;
+  void          *p;
+  int            fd, err;
+
+  if ((s = calloc (1, sizeof (*s))) == NULL)
+  {
+    return NULL;
+  }
+  if ((fd = shm_open (name? name: BLINKD_STATE_NAME,
+                      O_RDONLY | O_CLOEXEC, 0)) == -1)
+  {
+    free (s);
+    return NULL;
+  }
+  p = MAP_FAILED;
+  if (fstat (fd, &st) == 0)
+  {
+    if ((size_t) st.st_size < sizeof (*s->shm))
+    {
+      errno = EPROTO;
+    }
+    else
+    {
+      p = mmap (NULL, sizeof (*s->shm), PROT_READ, MAP_SHARED, fd, 0);
+    }
+  }
+  err = errno;
+  close (fd);
+  if (p == MAP_FAILED)
+  {
+    free (s);
+    errno = err;
+    return NULL;
+  }
+  s->shm = p;
+  if (s->shm->version != BLINKD_STATE_VERSION)
+  {
+    blink_state_close (s);
+    errno = EPROTO;
+    return NULL;
+  }
+  return s;
+}
+
+/* blink_state_close - unmap the LED state */
+void
+blink_state_close (blink_state_t *s)
+{
+  if (s == NULL)
+  {
+    return;
+  }
+  munmap ((void *) s->shm, sizeof (*s->shm));
+  free (s);
+}
+
+/* blink_state_read - take a consistent snapshot of the LED state
+
+   No syscall and no lock, unless blinkd is writing just then.  Fails
+   with EAGAIN if the state never settles and with ESRCH once blinkd
+   has exited.
+*/
+int
+blink_state_read (const blink_state_t *s,
+                  blink_status_t *status)
+{
+  blinkd_state_t copy;
+  uint32_t       seq;
+  int            i;
+
+  for (i = 0; i < STATE_TRIES; i++)
+  {
+    if ((seq = __atomic_load_n (&s->shm->seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+      sched_yield ();           /* let the writer finish */
+      continue;
+    }
+    memcpy (&copy, s->shm, sizeof (copy));
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (__atomic_load_n (&s->shm->seq, __ATOMIC_RELAXED) == seq)
+    {
+      break;
+    }
+  }
+  if (i == STATE_TRIES)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (!copy.pid)
+  {
+    errno = ESRCH;
+    return -1;
+  }
+  status->generation      = copy.generation;
+  status->updated.tv_sec  = copy.updated_ns / 1000000000;
+  status->updated.tv_nsec = copy.updated_ns % 1000000000;
+  status->pid             = copy.pid;
+  for (i = BLINK_CAP; i < BLINK_ALL; i++)
+  {
+    status->rate[i] = (copy.rate[i] == BLINKD_RATE_NONE)? -1: copy.rate[i];
+  }
+  status->lit      = copy.lit;
+  status->on_ms    = copy.on_ms;
+  status->off_ms   = copy.off_ms;
+  status->pause_ms = copy.pause_ms;
+  status->channels = copy.channels;
+  return 0;
+}
+
+/* read_reply - read the statistics reply of either protocol
+
+   v1 text ends with an empty line; v2 has a frame header, request id,
+   status and the length of the text.
+*/
+static int
+read_reply (blink_t *b,
+            unsigned char *buf,
+            size_t len,
+            int text)
+{
+  unsigned char hdr[BLINKD_HDR_SIZE + 5];
+  size_t        have = 0, want = text? len - 1: sizeof (hdr);
+  unsigned char *p   = text? buf: hdr;
+
+  while (have < want)
+  {
+    ssize_t rr = recv (b->fd, p + have, want - have, MSG_DONTWAIT);
+
+    if (rr > 0)
+    {
+      have += rr;
+      if (text && have >= 2 && p[have - 1] == '\n' && p[have - 2] == '\n')
+      {
+        break;
+      }
+      if (!text && p == hdr && have == want)
+      {
+        /* the text follows, drop what does not fit */
+        size_t n = (hdr[BLINKD_HDR_SIZE + 3] << 8) | hdr[BLINKD_HDR_SIZE + 4];
+
+        if (hdr[0] != BLINKD_V2 || !(hdr[1] & BLINKD_F_REPLY))
+        {
+          errno = EPROTO;
+          return -1;
+        }
+        p    = buf;
+        have = 0;
+        want = (n < len)? n: len - 1;
+      }
+      continue;
+    }
+    if (rr == 0 && text && have)
+    {
+      break;                    /* the text was cut short */
+    }
+    if (rr == 0)
+    {
+      drop_connection (b);
+      errno = ECONNRESET;
+      return -1;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+      if (wait_fd (b, POLLIN) == -1)
+      {
+        return -1;
+      }
+    }
+    else if (errno != EINTR)
+    {
+      return -1;
+    }
+  }
+  buf[have] = '\0';
+  return have;
+}
+
+/* wait_fd - wait for the socket, at most REPLY_TIMEOUT */
+static int
+wait_fd (blink_t *b,
+         short events)
+{
+  struct pollfd pfd;
+  int           rc;
+
+  pfd.fd     = b->fd;
+  pfd.events = events;
+  while ((rc = poll (&pfd, 1, REPLY_TIMEOUT)) == -1 && errno == EINTR)
+  {
+  }
+  if (rc == 0)
+  {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  return (rc == -1)? -1: 0;
+}
+
+/* connect_server - connect to blinkd
+
+   For the local machine the local socket is preferred, as it avoids
+   the name lookup and the tcp stack.  If it is not there, fall back
+   to tcp or udp, unless a local socket was given explicitly.
+*/
+static int
+connect_server (blink_t *b)
+{
+  struct addrinfo  hints, *res, *ai;
+  char             port[16];
+  int              type = (b->flags & BLINK_DATAGRAM)? SOCK_DGRAM: SOCK_STREAM;
+  int              flags = SOCK_CLOEXEC;
+  int              rc;
+
+  if (b->flags & BLINK_NONBLOCK)
+  {
+    flags |= SOCK_NONBLOCK;
+  }
+  if (b->path != NULL ||
+      (!b->port && (b->host == NULL || !strcmp (b->host, "localhost"))))
+  {
+    const char *path = b->path;
+
+    if (path == NULL)
+    {
+      path = (type == SOCK_DGRAM)? BLINKD_DGRAM_PATH: BLINKD_SOCKET_PATH;
+    }
+    if ((b->fd = connect_unix (path, type | flags)) != -1 ||
+        b->path != NULL)
+    {
+      return (b->fd == -1)? -1: 0;
+    }
+  }
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family   = AF_INET;
+  hints.ai_socktype = type;
+  sprintf (port, "%d", b->port? b->port: SERV_TCP_PORT);
+  if ((rc = getaddrinfo (b->host? b->host: "localhost", port, &hints,
+                         &res)))
+  {
+    errno = (rc == EAI_SYSTEM)? errno: EHOSTUNREACH;
+    return -1;
+  }
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+  {
+    if ((b->fd = socket (ai->ai_family, type | flags, 0)) == -1)
+    {
+      continue;
+    }
+    if (connect (b->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+    {
+      break;
+    }
+    if (errno == EINPROGRESS)
+    {
+      b->connecting = 1;
+      break;
+    }
+    close (b->fd);
+    b->fd = -1;
+  }
+  freeaddrinfo (res);
+  return (b->fd == -1)? -1: 0;
+}
+
+/* check_connect - see whether a non-blocking connect is done
+
+   Returns 0 once it is, -1 otherwise, with connecting still set while
+   it goes on.
+*/
+static int
+check_connect (blink_t *b)
+{
+  struct pollfd pfd;
+  socklen_t     len = sizeof (int);
+  int           err = 0;
+
+  pfd.fd     = b->fd;
+  pfd.events = POLLOUT;
+  if (poll (&pfd, 1, 0) == 0)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (getsockopt (b->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err)
+  {
+    drop_connection (b);
+    errno = err? err: errno;
+    return -1;
+  }
+  b->connecting = 0;
+  return 0;
+}
+
+/* connect_unix - connect to a local socket, "@name" is abstract */
+static int
+connect_unix (const char *path,
+              int type)
+{
+  struct sockaddr_un addr;
+  socklen_t          addrlen;
+  size_t             len = strlen (path);
+  int                sockfd;
+
+  if (!len || len >= sizeof (addr.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  memcpy (addr.sun_path, path, len);
+  addrlen = offsetof (struct sockaddr_un, sun_path) + len;
+  if (*path == '@')
+  {
+    addr.sun_path[0] = '\0';
+  }
+  else
+  {
+    addrlen++;
+  }
+  if ((sockfd = socket (AF_UNIX, type, 0)) < 0)
+  {
+    return -1;
+  }
+  if (connect (sockfd, (struct sockaddr *) &addr, addrlen) < 0)
+  {
+    int saved = errno;
+
+    close (sockfd);
+    errno = saved;
+    return -1;
+  }
+  return sockfd;
+}
+
+/* drop_connection - close the socket, partly sent frames go again */
+static void
+drop_connection (blink_t *b)
+{
+  close (b->fd);                /* ignore any errors */
+  b->fd         = -1;
+  b->connecting = 0;
+  b->out_sent   = 0;
+  b->proto      = 0;
+}
@@ -0,0 +1,91 @@
+/* File: libblink.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* libblink - talk to blinkd without running blink.
+
+   A handle keeps its connection open and connects again when it is
+   lost.  Commands are only queued, and coalesced per LED as long as
+   that does not change their effect, until blink_flush() sends them
+   in one frame, or as v1 octets if v1 can express them, so blinkd
+   0.4.8 understands them too.  With BLINK_NONBLOCK nothing ever
+   waits: what cannot be sent yet stays buffered, blink_fd() and
+   blink_events() tell what to poll for and blink_handle() continues.
+   Functions return -1 and set errno on errors.  The blink_state_ functions read the LED state
+   blinkd publishes in shared memory, without talking to it. */
+
+#ifndef LIBBLINK_H
+#define LIBBLINK_H
+
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {BLINK_CAP, BLINK_NUM, BLINK_SCR, BLINK_ALL} blink_led_t;
+
+#define BLINK_DATAGRAM  0x01    /* send datagrams, no connection */
+#define BLINK_NONBLOCK  0x02    /* never wait, buffer instead */
+#define BLINK_V1        0x04    /* one octet per command, rates 0..29 */
+#define BLINK_RING      0x08    /* shared memory ring of blinkd --ring */
+
+typedef struct blink_s blink_t;
+typedef struct blink_state_s blink_state_t;
+
+typedef struct {
+  unsigned long   generation;   /* updates published by blinkd */
+  struct timespec updated;      /* CLOCK_REALTIME of the last one */
+  long            pid;          /* of blinkd */
+  int             rate[3];      /* per blink_led_t, -1 if not in use */
+  int             lit;          /* bit 1 << led set while it is on */
+  int             on_ms;        /* times of the count pattern */
+  int             off_ms;
+  int             pause_ms;
+  int             channels;     /* panel LEDs of blinkd --channels */
+} blink_status_t;
+
+/* With host NULL or "localhost" and port 0 the local socket is tried
+   first, path NULL is the default one.  Otherwise, or if it is not
+   there, tcp or udp port is used, 0 is the default one.  With
+   BLINK_RING, path names the ring instead and host and port are not
+   used.  Commands go into the ring without a syscall, except for
+   waking up blinkd, there are no replies and nothing to poll. */
+blink_t *blink_open   (const char *host, int port, const char *path,
+                       int flags);
+void     blink_close  (blink_t *b);
+int      blink_set    (blink_t *b, blink_led_t led, int rate);
+int      blink_add    (blink_t *b, blink_led_t led, int delta);
+int      blink_reset  (blink_t *b);
+int      blink_flush  (blink_t *b); /* 0 all sent, 1 still pending */
+int      blink_fd     (const blink_t *b);
+int      blink_events (const blink_t *b); /* poll() events to wait for */
+int      blink_handle (blink_t *b, int revents);
+int      blink_stats  (blink_t *b, char *buf, size_t len);
+
+/* name NULL is the default shared memory object */
+blink_state_t *blink_state_open  (const char *name);
+int            blink_state_read  (const blink_state_t *s,
+                                  blink_status_t *status);
+void           blink_state_close (blink_state_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBBLINK_H */
@@ -0,0 +1,271 @@
+/* File: log.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <log.h>
+
+/* macros */
+#define LOG_RING_SIZE   256     /* power of two */
+#define LOG_TEXT_MAX    160
+#define LOG_RATE        20      /* messages per second passed to syslog */
+
+/* type definitions */
+typedef struct {
+  unsigned long seq;            /* slot is free for producer seq,
+                                   readable for consumer seq - 1 */
+  int           priority;
+  char          text[LOG_TEXT_MAX];
+} log_slot_t;
+
+/* function prototypes */
+static void *flusher      (void *unused);
+static int   log_drain    (int limited);
+
+/* global variables */
+int                  log_level  = LOG_INFO;
+static log_slot_t    ring[LOG_RING_SIZE];
+static unsigned long ring_head  = 0; /* next slot for producers */
+static unsigned long ring_tail  = 0; /* next slot for the flusher */
+static unsigned long dropped    = 0; /* ring full */
+static unsigned long suppressed = 0; /* over the rate limit */
+static int           tokens     = LOG_RATE;
+static time_t        refill     = 0;
+static sem_t         pending;
+static int           started    = 0; /* set once the ring is ready */
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* log_start - set up the ring and start the flusher thread */
+void
+log_start (void)
+{
+  pthread_t thread;
+  int       i;
+
+  for (i = 0; i < LOG_RING_SIZE; i++)
+  {
+    ring[i].seq = i;
+  }
+  if (sem_init (&pending, 0, 0) == -1 ||
+      pthread_create (&thread, NULL, &flusher, NULL))
+  {
+    syslog (LOG_ERR, "cannot start log thread, logging synchronously\n");
+    return;
+  }
+  pthread_detach (thread);
+  __atomic_store_n (&started, 1, __ATOMIC_RELEASE);
+}
+
+/* log_msg - queue a message for syslog, never blocks
+
+   Claiming a slot is a compare-and-swap on ring_head; the slot's
+   sequence number tells whether the flusher is done with it.  If the
+   ring is full, the message is counted and dropped.
+*/
+void
+log_msg (int priority,
+         const char *format,
+         ...)
+{
+  va_list       ap;
+  unsigned long pos;
+  log_slot_t   *slot;
+  int           saved_errno = errno; /* for %m */
+
+  if (!LOG_ON (priority))
+  {
+    return;
+  }
+  if (!__atomic_load_n (&started, __ATOMIC_ACQUIRE))
+  {
+    va_start (ap, format);
+    vsyslog (priority, format, ap);
+    va_end (ap);
+    return;
+  }
+  pos = __atomic_load_n (&ring_head, __ATOMIC_RELAXED);
+  while (1)
+  {
+    long diff;
+
+    slot = &ring[pos & (LOG_RING_SIZE - 1)];
+    diff = (long) (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0)
+    {
+      if (__atomic_compare_exchange_n (&ring_head, &pos, pos + 1, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      __atomic_fetch_add (&dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    else
+    {
+      pos = __atomic_load_n (&ring_head, __ATOMIC_RELAXED);
+    }
+  }
+  slot->priority = priority;
+  errno          = saved_errno;
+  va_start (ap, format);
+  vsnprintf (slot->text, sizeof (slot->text), format, ap);
+  va_end (ap);
+  __atomic_store_n (&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  sem_post (&pending);
+  errno = saved_errno;
+}
+
+/* log_flush - pass everything queued to syslog now, e.g. before exit,
+   never from a signal handler */
+void
+log_flush (void)
+{
+  if (__atomic_load_n (&started, __ATOMIC_ACQUIRE))
+  {
+    log_drain (0);
+  }
+}
+
+/* log_parse_level - syslog priority for a name or number, -1 if none */
+int
+log_parse_level (const char *name)
+{
+  static const char *names[] =
+  {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+  };
+  char *end;
+  long  level;
+  int   i;
+
+  for (i = LOG_EMERG; i <= LOG_DEBUG; i++)
+  {
+    if (!strcasecmp (name, names[i]))
+    {
+      return i;
+    }
+  }
+  level = strtol (name, &end, 10);
+  if (*name == '\0' || *end != '\0' || level < LOG_EMERG || level > LOG_DEBUG)
+  {
+    return -1;
+  }
+  return (int) level;
+}
+
+/* flusher - background thread passing queued messages to syslog
+
+   Sleeps until a message arrives.  Only while messages are being
+   suppressed it wakes up once a second, to report how many.
+*/
+static void *
+flusher (void *unused)
+{
+  while (1)
+  {
+    int rc;
+
+    if (__atomic_load_n (&suppressed, __ATOMIC_RELAXED) ||
+        __atomic_load_n (&dropped, __ATOMIC_RELAXED))
+    {
+      struct timespec ts;
+
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_sec++;
+      rc = sem_timedwait (&pending, &ts);
+    }
+    else
+    {
+      rc = sem_wait (&pending);
+    }
+    if (rc == -1 && errno == EINTR)
+    {
+      continue;
+    }
+    log_drain (1);
+  }
+  return unused;                /* never reached */
+}
+
+/* log_drain - hand all queued messages to syslog, returns how many
+
+   With limited set, only LOG_RATE messages per second are passed on,
+   the rest is counted and summarized once the rate allows it again.
+*/
+static int
+log_drain (int limited)
+{
+  int    n = 0;
+  time_t now;
+
+  pthread_mutex_lock (&drain_mutex);
+  now = time (NULL);
+  if (now != refill)
+  {
+    refill = now;
+    tokens = LOG_RATE;
+  }
+  if (tokens > 0 || !limited)   /* report what was lost so far */
+  {
+    unsigned long lost = __atomic_exchange_n (&dropped, 0, __ATOMIC_RELAXED) +
+      __atomic_exchange_n (&suppressed, 0, __ATOMIC_RELAXED);
+
+    if (lost)
+    {
+      syslog (LOG_NOTICE, "%lu messages suppressed\n", lost);
+      tokens--;
+    }
+  }
+  while (1)
+  {
+    log_slot_t *slot = &ring[ring_tail & (LOG_RING_SIZE - 1)];
+
+    if (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) != ring_tail + 1)
+    {
+      break;                    /* empty */
+    }
+    if (!limited || tokens > 0)
+    {
+      syslog (slot->priority, "%s\n", slot->text);
+      tokens--;
+    }
+    else
+    {
+      __atomic_fetch_add (&suppressed, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n (&slot->seq, ring_tail + LOG_RING_SIZE,
+                      __ATOMIC_RELEASE);
+    ring_tail++;
+    n++;
+  }
+  pthread_mutex_unlock (&drain_mutex);
+  return n;
+}
@@ -0,0 +1,34 @@
+/* File: log.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Asynchronous logging for blinkd.  log_msg() only formats the message
+   into a lock-free ring buffer, a background thread hands it over to
+   syslog(3), at most LOG_RATE messages per second.  Priorities are the
+   syslog ones, everything above log_level is dropped right away. */
+
+#include <syslog.h>
+
+extern int log_level;
+
+void log_flush (void);
+void log_msg   (int priority, const char *format, ...)
+  __attribute__ ((format (printf, 2, 3)));
+int  log_parse_level (const char *name);
+void log_start (void);
+
+#define LOG_ON(priority) ((priority) <= log_level)
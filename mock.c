@@ -0,0 +1,143 @@
+/* File: mock.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* The mock backend drives no device at all.  It keeps the LED state in
+   memory and records the last MOCK_EDGES changes with their time, so
+   benchmarks measure blinkd without any device cost.  If an argument
+   is given, the edges are written to that file on exit as lines
+   "seconds.nanoseconds mask", using the monotonic clock.  It drives
+   any number of panel LEDs too, their edges are lines
+   "seconds.nanoseconds on panel". */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include <backend.h>
+
+/* macros */
+#define MOCK_EDGES      65536   /* edges kept, older ones are dropped */
+
+/* type definitions */
+typedef struct {
+  struct timespec time;
+  int             mask;         /* or on, for a panel LED */
+  int             panel;        /* -1 for the keyboard LEDs */
+} edge_t;
+
+/* function prototypes */
+static int mock_apply   (int mask);
+static int mock_close   (void);
+static int mock_open    (const char *arg);
+static int mock_read    (void);
+static int mock_release (void);
+static int mock_set     (int panel, int on);
+
+/* global variables */
+const backend_t backend_mock =
+{
+  "mock", 0,
+  mock_open, mock_apply, mock_read, mock_close, mock_release, NULL, NULL,
+  mock_set
+};
+static edge_t        edges[MOCK_EDGES];
+static unsigned long nedges = 0;
+static int           state  = 0;
+static const char   *path   = NULL;
+
+/* mock_open - remember where to write the edges to */
+static int
+mock_open (const char *arg)
+{
+  path = arg;
+  return 0;
+}
+
+/* mock_apply - record an edge */
+static int
+mock_apply (int mask)
+{
+  edge_t *e = &edges[nedges++ % MOCK_EDGES];
+
+  clock_gettime (CLOCK_MONOTONIC, &e->time);
+  e->mask  = mask;
+  e->panel = -1;
+  state    = mask;
+  return 0;
+}
+
+/* mock_set - record an edge of a panel LED, any number of them */
+static int
+mock_set (int panel,
+          int on)
+{
+  edge_t *e = &edges[nedges++ % MOCK_EDGES];
+
+  clock_gettime (CLOCK_MONOTONIC, &e->time);
+  e->mask  = on;
+  e->panel = panel;
+  return 0;
+}
+
+/* mock_read - return the recorded state */
+static int
+mock_read (void)
+{
+  return state;
+}
+
+/* mock_close - nothing to close */
+static int
+mock_close (void)
+{
+  return 0;
+}
+
+/* mock_release - write the recorded edges, oldest first */
+static int
+mock_release (void)
+{
+  FILE         *f;
+  unsigned long i = (nedges > MOCK_EDGES)? nedges - MOCK_EDGES: 0;
+
+  if (path == NULL)
+  {
+    return 0;
+  }
+  if ((f = fopen (path, "w")) == NULL)
+  {
+    return -1;
+  }
+  for (; i < nedges; i++)
+  {
+    edge_t *e = &edges[i % MOCK_EDGES];
+
+    if (e->panel == -1)
+    {
+      fprintf (f, "%ld.%09ld %d\n", (long) e->time.tv_sec,
+               e->time.tv_nsec, e->mask);
+    }
+    else
+    {
+      fprintf (f, "%ld.%09ld %d %d\n", (long) e->time.tv_sec,
+               e->time.tv_nsec, e->mask, e->panel);
+    }
+  }
+  return fclose (f);
+}
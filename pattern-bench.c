@@ -0,0 +1,196 @@
+/* File: pattern-bench.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Microbenchmark of the blink pattern engine.  Walks the steps of
+   every built-in pattern and of a compiled one the way the scheduler
+   does, and reports the edges computed per second.  Results are
+   "name value" lines or one JSON object per pattern. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+
+#include <pattern.h>
+
+/* function prototypes */
+static unsigned long now_ns       (void);
+static void          process_opts (int, char **);
+static void          run          (const char *);
+static void          usage        (char *);
+static void          wrong_use    (char *);
+
+/* global variables */
+static const char   *specs[]  = {"count", "heartbeat", "sos", "sweep",
+                                 "morse:blinkd 048"};
+static unsigned long count    = 10000000; /* edges per pattern */
+static int           rate     = 5;
+static int           json     = 0;
+static unsigned long sink     = 0;        /* keeps the work alive */
+
+/* main - run every pattern */
+int
+main (int argc,
+      char **argv)
+{
+  size_t i;
+
+  process_opts (argc, argv);
+  for (i = 0; i < sizeof (specs) / sizeof (*specs); i++)
+  {
+    run (specs[i]);
+  }
+  return (sink == 42)? EXIT_FAILURE: EXIT_SUCCESS;
+}
+
+/* run - time count edges of one pattern
+
+   Per edge the scheduler moves to the next step, adds its duration to
+   the deadline and looks up which LEDs it lights.
+*/
+static void
+run (const char *spec)
+{
+  const pattern_t *p;
+  pat_pos_t        pos;
+  unsigned long    start, elapsed, deadline = 0, cycles = 0, i;
+  unsigned int     lit = 0;
+  double           eps;
+
+  if ((p = pattern_parse (spec)) == NULL)
+  {
+    fprintf (stderr, "Bad pattern %s.\n", spec);
+    exit (EXIT_FAILURE);
+  }
+  pattern_start (&pos, rate);
+  start = now_ns ();
+  for (i = 0; i < count; i++)
+  {
+    cycles   += pattern_next (p, &pos, rate);
+    deadline += p->steps[pos.step].ms;
+    lit      ^= p->steps[pos.step].lit;
+  }
+  elapsed = now_ns () - start;
+  sink   += deadline + cycles + lit;
+  eps     = elapsed? count * 1e9 / elapsed: 0;
+  if (json)
+  {
+    printf ("{\"pattern\": \"%s\", \"steps\": %d, \"rate\": %d, "
+            "\"edges\": %lu, \"cycles\": %lu, \"elapsed_s\": %.3f, "
+            "\"edges_per_s\": %.0f, \"ns_per_edge\": %.2f}\n",
+            spec, p->nsteps, rate, count, cycles, elapsed / 1e9, eps,
+            count? (double) elapsed / count: 0);
+  }
+  else
+  {
+    printf ("pattern %s\n"
+            "steps %d\n"
+            "edges_per_s %.0f\n"
+            "ns_per_edge %.2f\n",
+            spec, p->nsteps, eps, count? (double) elapsed / count: 0);
+  }
+}
+
+/* now_ns - monotonic time in nano seconds */
+static unsigned long
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* process_opts - process command line, see function usage() for options */
+static void
+process_opts (int argc,
+              char **argv)
+{
+  int c = 0;
+
+  while (1)
+  {
+    int option_index                    = 0;
+    static struct option long_options[] =
+    {
+      {"help",          0, 0, 'h'},
+      {"json",          0, 0, 'j'},
+      {"count",         1, 0, 'n'},
+      {"rate",          1, 0, 'r'},
+      {"version",       0, 0, 'v'},
+      {0,               0, 0, 0}
+    };
+    c = getopt_long (argc, argv, "hjn:r:v", long_options, &option_index);
+    if (c == -1)
+    {
+      break;
+    }
+    switch (c)
+    {
+      case 'h':
+        usage (argv[0]);
+        exit (EXIT_SUCCESS);
+      case 'j':
+        json = 1;
+        break;
+      case 'n':
+        count = strtoul (optarg, NULL, 0);
+        break;
+      case 'r':
+        if ((rate = atoi (optarg)) < 1)
+        {
+          wrong_use (argv[0]);
+        }
+        break;
+      case 'v':
+        printf ("pattern-bench (%s) %s\n", PACKAGE, VERSION);
+        exit (EXIT_SUCCESS);
+      default:
+        wrong_use (argv[0]);
+    }
+  }
+  if (optind < argc)
+  {
+    wrong_use (argv[0]);
+  }
+}
+
+/* usage - help on options */
+static void
+usage (char* name)
+{
+  printf ("Usage: %s [options]\n"
+          "Options are\n"
+          "  -h,   --help          display this help and exit\n"
+          "  -j,   --json          print the results as JSON\n"
+          "  -n n, --count=n       compute n edges per pattern (10000000)\n"
+          "  -r n, --rate=n        blink rate for repeated steps (5)\n"
+          "  -v,   --version       output version information and exit\n",
+          name);
+}
+
+/* wrong_use - output for the user, if options cannot be interpreted */
+static void
+wrong_use (char *name)
+{
+  fprintf (stderr, "%s: Error in arguments.  Try %s --help.\n", name, name);
+  exit (EXIT_FAILURE);
+}
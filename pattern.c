@@ -0,0 +1,349 @@
+/* File: pattern.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <pattern.h>
+
+/* macros */
+#define MORSE_UNIT      200     /* ms of a dot */
+#define MORSE_MAX       256     /* characters of a morse text */
+#define TENTH           100     /* ms of a time without unit */
+
+/* the steps of the built-in patterns, put together at compile time */
+#define ON(ms)          {ms, PAT_SELF, 0}
+#define OFF(ms)         {ms, 0, 0}
+#define DIT             ON (MORSE_UNIT), OFF (MORSE_UNIT)
+#define DAH             ON (3 * MORSE_UNIT), OFF (MORSE_UNIT)
+#define LETTER_GAP      OFF (2 * MORSE_UNIT)
+#define WORD_GAP        OFF (6 * MORSE_UNIT)
+#define BUILTIN(name, steps) \
+  {name, steps, sizeof (steps) / sizeof (steps[0]), -1}
+
+/* function prototypes */
+static pattern_t *compile_count (const char *arg);
+static pattern_t *compile_morse (const char *text);
+static int        add_step      (pat_step_t *steps, int n, int ms,
+                                 int lit);
+
+/* global variables */
+static const pat_step_t heartbeat[] =
+{
+  ON (100), OFF (150), ON (100), OFF (650)
+};
+static const pat_step_t sos[] =
+{
+  DIT, DIT, DIT, LETTER_GAP, DAH, DAH, DAH, LETTER_GAP,
+  DIT, DIT, DIT, WORD_GAP
+};
+static const pat_step_t sweep[] =
+{
+  {150, PAT_SELF, 0}, {150, PAT_NEXT, 0}, {150, PAT_PREV, 0},
+  {150, PAT_NEXT, 0}
+};
+static const pattern_t builtins[] =
+{
+  BUILTIN ("heartbeat", heartbeat),
+  BUILTIN ("sos", sos),
+  BUILTIN ("sweep", sweep)
+};
+static const char *const morse_letters[26] =
+{
+  ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..",
+  ".---", "-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.",
+  "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--.."
+};
+static const char *const morse_digits[10] =
+{
+  "-----", ".----", "..---", "...--", "....-", ".....", "-....",
+  "--...", "---..", "----."
+};
+
+/* pattern_parse - the pattern for a description, NULL if it is bad
+
+   "count[:on,off,pause]" blinks rate times, times in tenths of a
+   second.  "heartbeat", "sos" and "sweep" are built in, "morse:text"
+   blinks the letters and digits of text.
+*/
+const pattern_t *
+pattern_parse (const char *spec)
+{
+  const char *arg = strchr (spec, ':');
+  size_t      len = arg? (size_t) (arg - spec): strlen (spec);
+  size_t      i;
+
+  if (len == 5 && !strncmp (spec, "count", len))
+  {
+    return compile_count (arg? arg + 1: "2,2,6");
+  }
+  if (len == 5 && !strncmp (spec, "morse", len) && arg != NULL)
+  {
+    return compile_morse (arg + 1);
+  }
+  for (i = 0; arg == NULL && i < sizeof (builtins) / sizeof (*builtins);
+       i++)
+  {
+    if (!strcmp (spec, builtins[i].name))
+    {
+      return &builtins[i];
+    }
+  }
+  return NULL;
+}
+
+/* pattern_count - the classic pattern: rate pulses, then a pause */
+const pattern_t *
+pattern_count (int on_ms,
+               int off_ms,
+               int pause_ms)
+{
+  pattern_t  *p;
+  pat_step_t *steps;
+
+  if ((p = malloc (sizeof (*p))) == NULL ||
+      (steps = calloc (4, sizeof (*steps))) == NULL)
+  {
+    free (p);
+    return NULL;
+  }
+  add_step (steps, 0, on_ms, PAT_SELF);
+  add_step (steps, 1, off_ms, 0);
+  steps[2].back = 2;            /* the repeat step */
+  add_step (steps, 3, pause_ms, 0);
+  p->name   = "count";
+  p->steps  = steps;
+  p->nsteps = 4;
+  p->repeat = 2;
+  return p;
+}
+
+/* compile_count - pattern_count() for "on,off,pause" */
+static pattern_t *
+compile_count (const char *arg)
+{
+  int  t[3];
+  int  i;
+  char *end;
+
+  for (i = 0; i < 3; i++)
+  {
+    if ((t[i] = pattern_time (arg, &end)) == -1 ||
+        *end != ((i < 2)? ',': '\0'))
+    {
+      return NULL;
+    }
+    arg = end + 1;
+  }
+  return (pattern_t *) pattern_count (t[0], t[1], t[2]);
+}
+
+/* compile_morse - a pattern blinking text in morse code
+
+   Dots are one unit, dashes three, with one unit between them, three
+   between letters and seven between words and before repeating.
+*/
+static pattern_t *
+compile_morse (const char *text)
+{
+  pattern_t  *p;
+  pat_step_t *steps;
+  size_t      len = strlen (text);
+  int         n   = 0;
+
+  if (!len || len > MORSE_MAX ||
+      (p = malloc (sizeof (*p))) == NULL)
+  {
+    return NULL;
+  }
+  /* at most 5 symbols of 2 steps per character, merged gaps */
+  if ((steps = calloc (len * 10 + 1, sizeof (*steps))) == NULL)
+  {
+    free (p);
+    return NULL;
+  }
+  for (; *text; text++)
+  {
+    const char *code;
+
+    if (*text == ' ')
+    {
+      n = add_step (steps, n, 4 * MORSE_UNIT, 0);
+      continue;
+    }
+    if (isdigit ((unsigned char) *text))
+    {
+      code = morse_digits[*text - '0'];
+    }
+    else if (isalpha ((unsigned char) *text))
+    {
+      code = morse_letters[toupper ((unsigned char) *text) - 'A'];
+    }
+    else
+    {
+      free (steps);
+      free (p);
+      return NULL;
+    }
+    for (; *code; code++)
+    {
+      n = add_step (steps, n, ((*code == '-')? 3: 1) * MORSE_UNIT,
+                    PAT_SELF);
+      n = add_step (steps, n, MORSE_UNIT, 0);
+    }
+    n = add_step (steps, n, 2 * MORSE_UNIT, 0);
+  }
+  n = add_step (steps, n, 4 * MORSE_UNIT, 0);
+  p->name   = "morse";
+  p->steps  = steps;
+  p->nsteps = n;
+  p->repeat = -1;
+  return p;
+}
+
+/* add_step - set step n, or make step n - 1 longer if it looks the same
+
+   Steps last at least 1 ms, 0 would be a repeat step.  Returns the
+   number of steps.
+*/
+static int
+add_step (pat_step_t *steps,
+          int n,
+          int ms,
+          int lit)
+{
+  ms = (ms < 1)? 1: (ms > PAT_MS_MAX)? PAT_MS_MAX: ms;
+  if (n && steps[n - 1].ms && steps[n - 1].lit == lit &&
+      steps[n - 1].ms + ms <= PAT_MS_MAX)
+  {
+    steps[n - 1].ms += ms;
+    return n;
+  }
+  steps[n].ms   = ms;
+  steps[n].lit  = lit;
+  steps[n].back = 0;
+  return n + 1;
+}
+
+/* pattern_time - a time in ms, from tenths of a second or with a unit
+
+   The number may be followed by "ms" or "s", "3" is the same as
+   "300ms" and "0.3s".  end is set to the first character after it.
+   Digits and a '.' are read by hand, so any locale reads the same.
+   Fractions of a ms are rounded.  Returns -1 for anything but a time
+   from 0 to PAT_MS_MAX.
+*/
+int
+pattern_time (const char *arg,
+              char **end)
+{
+  long   value = 0, scale = 1;  /* the number is value / scale */
+  long   unit;
+  double ms;
+
+  if (!isdigit ((unsigned char) *arg))
+  {
+    return -1;
+  }
+  for (; isdigit ((unsigned char) *arg); arg++)
+  {
+    value = value * 10 + (*arg - '0');
+    if (value > PAT_MS_MAX)
+    {
+      return -1;
+    }
+  }
+  if (*arg == '.')
+  {
+    for (arg++; isdigit ((unsigned char) *arg); arg++)
+    {
+      if (scale < 1000)         /* a ms of a second is fine enough */
+      {
+        value  = value * 10 + (*arg - '0');
+        scale *= 10;
+      }
+    }
+  }
+  if (!strncmp (arg, "ms", 2))
+  {
+    unit = 1;
+    arg += 2;
+  }
+  else if (*arg == 's')
+  {
+    unit = 1000;
+    arg++;
+  }
+  else
+  {
+    unit = TENTH;
+  }
+  *end = (char *) arg;
+  ms   = (double) value * unit / scale + 0.5; /* to the nearest ms */
+  return (ms >= PAT_MS_MAX + 1)? -1: (int) ms;
+}
+
+/* pattern_start - begin a cycle at the first step */
+void
+pattern_start (pat_pos_t *pos,
+               int rate)
+{
+  pos->step = 0;
+  pos->left = rate;
+}
+
+/* pattern_next - move on to the next step that lasts
+
+   Repeat steps jump back while pulses are left.  Returns 1 if a new
+   cycle begins.
+*/
+int
+pattern_next (const pattern_t *p,
+              pat_pos_t *pos,
+              int rate)
+{
+  int cycle_done = 0;
+
+  pos->step++;
+  while (1)
+  {
+    const pat_step_t *s;
+
+    if (pos->step >= p->nsteps)
+    {
+      pattern_start (pos, rate);
+      cycle_done = 1;
+    }
+    s = &p->steps[pos->step];
+    if (s->ms)
+    {
+      return cycle_done;
+    }
+    if (--pos->left > 0)
+    {
+      pos->step -= s->back;
+    }
+    else
+    {
+      pos->step++;
+    }
+  }
+}
@@ -0,0 +1,54 @@
+/* File: pattern.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Blink patterns of blinkd: timelines of steps, each lighting some
+   LEDs for a number of milliseconds.  A repeat step jumps back once
+   per unit of the blink rate, so the classic pattern of rate pulses
+   followed by a pause is just four steps.  Built-in patterns are
+   static tables, pattern_parse() compiles the others once at startup;
+   the scheduler only walks the steps. */
+
+#define PAT_SELF        0x01    /* the LED the pattern runs on */
+#define PAT_NEXT        0x02    /* the next one, Caps, Num, Scroll */
+#define PAT_PREV        0x04    /* the one before */
+#define PAT_MS_MAX      65535   /* longest step */
+
+typedef struct {
+  unsigned short ms;            /* duration, 0 for the repeat step */
+  unsigned char  lit;           /* PAT_ bits lit during the step */
+  unsigned char  back;          /* repeat step: steps to jump back */
+} pat_step_t;
+
+typedef struct {
+  const char       *name;
+  const pat_step_t *steps;
+  int               nsteps;
+  int               repeat;     /* index of the repeat step or -1 */
+} pattern_t;
+
+typedef struct {
+  int step;                     /* current step */
+  int left;                     /* jumps back left at the repeat step */
+} pat_pos_t;
+
+const pattern_t *pattern_count (int on_ms, int off_ms, int pause_ms);
+int              pattern_next  (const pattern_t *p, pat_pos_t *pos,
+                                int rate);
+const pattern_t *pattern_parse (const char *spec);
+void             pattern_start (pat_pos_t *pos, int rate);
+int              pattern_time  (const char *arg, char **end);
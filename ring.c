@@ -0,0 +1,188 @@
+/* File: ring.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <blinkd.h>
+#include <ring.h>
+
+/* function prototypes */
+static int stale (const char *name);
+
+/* global variables */
+static blinkd_ring_t   *ring      = NULL;
+static blinkd_record_t *records   = NULL;
+static size_t           ring_len  = 0;  /* octets mapped */
+static uint32_t         mask      = 0;  /* not taken from the ring */
+static uint32_t         tail      = 0;  /* next ticket to take */
+static const char      *ring_name = NULL;
+
+/* ring_start - create the ring for size records, rounded up to a
+   power of 2
+
+   Who may push is given by mode and group gid, -1 to keep the group.
+   A ring left behind by a blinkd no longer running is replaced, one
+   of a running blinkd fails with EEXIST.  Returns -1 with errno set
+   on errors.
+*/
+int
+ring_start (const char *name,
+            int size,
+            mode_t mode,
+            gid_t gid)
+{
+  uint32_t n = 1;
+  void    *p;
+  int      fd, err;
+
+  while ((int) n < size)
+  {
+    n <<= 1;
+  }
+  ring_len = sizeof (*ring) + n * sizeof (*records);
+  while ((fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                         mode)) == -1)
+  {
+    if (errno != EEXIST || !stale (name) ||
+        (shm_unlink (name) == -1 && errno != ENOENT))
+    {
+      return -1;
+    }
+  }
+  if (fchmod (fd, mode) == -1 ||   /* not masked by the umask */
+      (gid != (gid_t) -1 && fchown (fd, -1, gid) == -1) ||
+      ftruncate (fd, ring_len) == -1 ||
+      (p = mmap (NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0)) == MAP_FAILED)
+  {
+    err = errno;
+    close (fd);
+    shm_unlink (name);
+    errno = err;
+    return -1;
+  }
+  close (fd);
+  ring      = p;
+  records   = (blinkd_record_t *) (ring + 1);
+  ring_name = name;
+  mask      = n - 1;
+  for (tail = 0; tail < n; tail++)
+  {
+    records[tail].seq = tail;
+  }
+  tail       = 0;
+  ring->size = n;
+  ring->pid  = getpid ();
+  __atomic_store_n (&ring->version, BLINKD_RING_VERSION, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/* stale - is the ring there left behind by a blinkd no longer
+   running?  errno is EEXIST if not. */
+static int
+stale (const char *name)
+{
+  const blinkd_ring_t *old;
+  struct stat          st;
+  int                  fd, gone = 0;
+
+  if ((fd = shm_open (name, O_RDONLY | O_CLOEXEC, 0)) == -1)
+  {
+    return errno == ENOENT;     /* removed meanwhile, try again */
+  }
+  if (fstat (fd, &st) == 0 && (size_t) st.st_size >= sizeof (*old) &&
+      (old = mmap (NULL, sizeof (*old), PROT_READ, MAP_SHARED,
+                   fd, 0)) != MAP_FAILED)
+  {
+    gone = __atomic_load_n (&old->version, __ATOMIC_ACQUIRE) ==
+           BLINKD_RING_VERSION &&
+           (!old->pid || (kill (old->pid, 0) == -1 && errno == ESRCH));
+    munmap ((void *) old, sizeof (*old));
+  }
+  close (fd);
+  errno = EEXIST;
+  return gone;
+}
+
+/* ring_pop - take the next record
+
+   Copies its octets to buf, which has room for BLINKD_RING_DATA, and
+   returns their number, or -1 if the ring is empty.  Nothing in the
+   ring but the record is trusted.
+*/
+int
+ring_pop (unsigned char *buf)
+{
+  blinkd_record_t *r = &records[tail & mask];
+  int              len;
+
+  if (__atomic_load_n (&r->seq, __ATOMIC_ACQUIRE) != tail + 1)
+  {
+    return -1;
+  }
+  len = (r->len > BLINKD_RING_DATA)? BLINKD_RING_DATA: r->len;
+  memcpy (buf, r->data, len);
+  __atomic_store_n (&r->seq, tail + mask + 1, __ATOMIC_RELEASE);
+  tail++;
+  return len;
+}
+
+/* ring_wait - sleep until a producer pushes, or the timeout is over
+
+   timeout NULL waits for ever.  Returns 1 if woken by a producer, 0
+   otherwise, -1 on errors.
+*/
+int
+ring_wait (const struct timespec *timeout)
+{
+  __atomic_store_n (&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&records[tail & mask].seq, __ATOMIC_ACQUIRE) ==
+      tail + 1)
+  {
+    __atomic_store_n (&ring->sleeping, 0, __ATOMIC_RELAXED);
+    return 0;
+  }
+  if (syscall (SYS_futex, &ring->sleeping, FUTEX_WAIT, 1, timeout,
+               NULL, 0) == -1)
+  {
+    return (errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT)?
+           0: -1;
+  }
+  return 1;
+}
+
+/* ring_stop - remove the ring, whoever mapped it keeps it */
+void
+ring_stop (void)
+{
+  if (ring != NULL)
+  {
+    shm_unlink (ring_name);
+  }
+}
@@ -0,0 +1,28 @@
+/* File: ring.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* blinkd's end of the command ring in shared memory, see
+   blinkd_ring_t in blinkd.h.  Only one thread takes records. */
+
+#include <time.h>
+#include <sys/types.h>
+
+int  ring_start (const char *name, int size, mode_t mode, gid_t gid);
+int  ring_pop   (unsigned char *buf);
+int  ring_wait  (const struct timespec *timeout);
+void ring_stop  (void);
@@ -0,0 +1,146 @@
+/* File: ringpush.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <blinkd.h>
+#include <ringpush.h>
+
+/* ringpush_map - map the ring name, NULL for the default one
+
+   Fails with EPROTO for a ring of an unknown layout, or one blinkd is
+   still setting up.
+*/
+int
+ringpush_map (ringpush_t *rp,
+              const char *name)
+{
+  blinkd_ring_t *ring;
+  struct stat    st;
+  uint32_t       size;
+  int            fd, err;
+
+  if ((fd = shm_open (name? name: BLINKD_RING_NAME,
+                      O_RDWR | O_CLOEXEC, 0)) == -1)
+  {
+    return -1;
+  }
+  ring = MAP_FAILED;
+  if (fstat (fd, &st) == 0)
+  {
+    if ((size_t) st.st_size < sizeof (*ring))
+    {
+      errno = EPROTO;
+    }
+    else
+    {
+      ring = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    }
+  }
+  err = errno;
+  close (fd);
+  if (ring == MAP_FAILED)
+  {
+    errno = err;
+    return -1;
+  }
+  /* blinkd stores the version last, the size is only valid after it */
+  if (__atomic_load_n (&ring->version, __ATOMIC_ACQUIRE) !=
+      BLINKD_RING_VERSION ||
+      (size = ring->size) == 0 || size & (size - 1) ||
+      size > (st.st_size - sizeof (*ring)) / sizeof (blinkd_record_t))
+  {
+    munmap (ring, st.st_size);
+    errno = EPROTO;
+    return -1;
+  }
+  rp->ring = ring;
+  rp->len  = st.st_size;
+  rp->mask = size - 1;
+  return 0;
+}
+
+/* ringpush_push - put one record of up to BLINKD_RING_DATA octets
+   into the ring
+
+   Only wakes blinkd if it went to sleep on an empty ring.  Returns -1
+   if the ring is full, without setting errno.
+*/
+int
+ringpush_push (const ringpush_t *rp,
+               const unsigned char *p,
+               size_t len)
+{
+  blinkd_ring_t   *ring    = rp->ring;
+  blinkd_record_t *records = (blinkd_record_t *) (ring + 1);
+  blinkd_record_t *r;
+  uint32_t         t       = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+
+  while (1)
+  {
+    int32_t diff;
+
+    r    = &records[t & rp->mask];
+    diff = (int32_t) (__atomic_load_n (&r->seq, __ATOMIC_ACQUIRE) - t);
+    if (diff == 0 &&
+        __atomic_compare_exchange_n (&ring->head, &t, t + 1, 1,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+      break;
+    }
+    if (diff < 0)
+    {
+      return -1;
+    }
+    if (diff > 0)
+    {
+      t = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+  r->len = len;
+  memcpy (r->data, p, len);
+  __atomic_store_n (&r->seq, t + 1, __ATOMIC_RELEASE);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&ring->sleeping, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n (&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+  {
+    syscall (SYS_futex, &ring->sleeping, FUTEX_WAKE, 1, NULL, NULL, 0);
+  }
+  return 0;
+}
+
+/* ringpush_unmap - let go of the ring */
+void
+ringpush_unmap (ringpush_t *rp)
+{
+  if (rp->ring != NULL)
+  {
+    munmap (rp->ring, rp->len);
+    rp->ring = NULL;
+  }
+}
@@ -0,0 +1,35 @@
+/* File: ringpush.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* The producers' end of the command ring of blinkd --ring, see
+   blinkd_ring_t in blinkd.h.  Used by libblink and blink-bench, so
+   both push exactly the same way.  Include blinkd.h first.  Functions
+   return -1 and set errno on errors. */
+
+#include <stddef.h>
+
+typedef struct {
+  blinkd_ring_t *ring;          /* NULL while not mapped */
+  size_t         len;           /* octets mapped */
+  uint32_t       mask;          /* as found when mapping */
+} ringpush_t;
+
+int  ringpush_map   (ringpush_t *rp, const char *name);
+int  ringpush_push  (const ringpush_t *rp, const unsigned char *p,
+                     size_t len);
+void ringpush_unmap (ringpush_t *rp);
@@ -0,0 +1,174 @@
+/* File: state.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <blinkd.h>
+#include <state.h>
+
+/* function prototypes */
+static int  stale       (const char *name);
+static void write_begin (void);
+static void write_end   (void);
+
+/* global variables */
+static blinkd_state_t *state      = NULL; /* NULL if not published */
+static const char     *state_name = NULL;
+
+/* state_start - create the shared memory object and map it
+
+   An empty name publishes nothing.  An object left behind by a blinkd
+   no longer running is replaced, one of a running blinkd fails with
+   EEXIST.  Returns -1 with errno set on errors.
+*/
+int
+state_start (const char *name,
+             int channels,
+             int on_ms,
+             int off_ms,
+             int pause_ms)
+{
+  void *p;
+  int   fd, err;
+
+  if (!*name)
+  {
+    return 0;
+  }
+  while ((fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                         0644)) == -1)
+  {
+    if (errno != EEXIST || !stale (name) ||
+        (shm_unlink (name) == -1 && errno != ENOENT))
+    {
+      return -1;
+    }
+  }
+  if (ftruncate (fd, sizeof (*state)) == -1 ||
+      (p = mmap (NULL, sizeof (*state), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0)) == MAP_FAILED)
+  {
+    err = errno;
+    close (fd);
+    shm_unlink (name);
+    errno = err;
+    return -1;
+  }
+  close (fd);
+  state            = p;
+  state_name       = name;
+  state->version   = BLINKD_STATE_VERSION;
+  state->pid       = getpid ();
+  state->channels  = channels;
+  state->on_ms     = on_ms;
+  state->off_ms    = off_ms;
+  state->pause_ms  = pause_ms;
+  return 0;
+}
+
+/* stale - is the object there left behind by a blinkd no longer
+   running?  errno is EEXIST if not. */
+static int
+stale (const char *name)
+{
+  const blinkd_state_t *old;
+  struct stat           st;
+  int                   fd, gone = 0;
+
+  if ((fd = shm_open (name, O_RDONLY | O_CLOEXEC, 0)) == -1)
+  {
+    return errno == ENOENT;     /* removed meanwhile, try again */
+  }
+  if (fstat (fd, &st) == 0 && (size_t) st.st_size >= sizeof (*old) &&
+      (old = mmap (NULL, sizeof (*old), PROT_READ, MAP_SHARED,
+                   fd, 0)) != MAP_FAILED)
+  {
+    gone = !old->pid || (kill (old->pid, 0) == -1 && errno == ESRCH);
+    munmap ((void *) old, sizeof (*old));
+  }
+  close (fd);
+  errno = EEXIST;
+  return gone;
+}
+
+/* state_publish - write rates and lit LEDs for the readers
+
+   rate holds the three LED rates, -1 for LEDs not in use, lit the
+   LEDs switched on, bit i for LED i.
+*/
+void
+state_publish (const int *rate,
+               int lit)
+{
+  struct timespec now;
+  int             i;
+
+  if (state == NULL)
+  {
+    return;
+  }
+  clock_gettime (CLOCK_REALTIME, &now);
+  write_begin ();
+  for (i = BLINKD_CAP; i < BLINKD_ALL; i++)
+  {
+    state->rate[i] = (rate[i] < 0)? BLINKD_RATE_NONE: rate[i];
+  }
+  state->lit        = lit;
+  state->updated_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+  state->generation++;
+  write_end ();
+}
+
+/* state_stop - tell the readers blinkd is gone and remove the object */
+void
+state_stop (void)
+{
+  if (state == NULL)
+  {
+    return;
+  }
+  write_begin ();
+  state->pid = 0;
+  write_end ();
+  shm_unlink (state_name);
+  state = NULL;
+}
+
+/* write_begin - make seq odd before anything else is written */
+static void
+write_begin (void)
+{
+  __atomic_store_n (&state->seq, state->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+/* write_end - make seq even after everything was written */
+static void
+write_end (void)
+{
+  __atomic_store_n (&state->seq, state->seq + 1, __ATOMIC_RELEASE);
+}
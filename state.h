@@ -0,0 +1,26 @@
+/* File: state.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* The LED state in shared memory for readers without syscalls, see
+   blinkd_state_t in blinkd.h.  Only the scheduler thread publishes,
+   until then state_start() may. */
+
+int  state_start   (const char *name, int channels, int on_ms,
+                    int off_ms, int pause_ms);
+void state_publish (const int *rate, int lit);
+void state_stop    (void);
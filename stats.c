@@ -0,0 +1,211 @@
+/* File: stats.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <stats.h>
+
+/* macros */
+#define SUB_BITS        4       /* 16 buckets per power of two, ~6% */
+#define SUB_COUNT       (1 << SUB_BITS)
+#define VALUE_BITS      32      /* values above 2^32 us are clamped */
+#define HIST_BUCKETS    ((VALUE_BITS - SUB_BITS + 1) << SUB_BITS)
+
+/* function prototypes */
+static unsigned int  bucket_index (unsigned long value);
+static unsigned long bucket_value (unsigned int index);
+static size_t        format_hist  (char *buf, size_t len, hist_t hist);
+
+/* global variables */
+unsigned long          stats_counters[STAT_MAX];
+static unsigned long   histograms[HIST_MAX][HIST_BUCKETS];
+static unsigned long   maxima[HIST_MAX]; /* exact, not a bucket */
+static struct timespec started;
+static const char     *counter_names[STAT_MAX] =
+{
+  "connections_accepted",
+  "datagrams_received",
+  "ring_records",
+  "ring_wakeups",
+  "octets_decoded",
+  "frames_decoded",
+  "octets_invalid",
+  "batches_queued",
+  "queue_full",
+  "edges_taken",
+  "ioctls_issued",
+  "ioctls_failed",
+  "ioctls_saved",
+  "console_opens"
+};
+static const char     *hist_names[HIST_MAX] =
+{
+  "accept_to_decode_us",
+  "decode_to_applied_us",
+  "device_apply_us"
+};
+
+/* stats_start - remember the start time for the uptime */
+void
+stats_start (void)
+{
+  clock_gettime (CLOCK_MONOTONIC, &started);
+}
+
+/* stats_elapsed_us - micro seconds since a CLOCK_MONOTONIC time */
+unsigned long
+stats_elapsed_us (const struct timespec *since)
+{
+  struct timespec now;
+  long            usec;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  usec = (now.tv_sec - since->tv_sec) * 1000000L +
+    (now.tv_nsec - since->tv_nsec) / 1000;
+  return (usec > 0)? (unsigned long) usec: 0;
+}
+
+/* stats_record - count a value in a histogram, lock-free */
+void
+stats_record (hist_t hist,
+              unsigned long usec)
+{
+  unsigned long max = __atomic_load_n (&maxima[hist], __ATOMIC_RELAXED);
+
+  __atomic_fetch_add (&histograms[hist][bucket_index (usec)], 1,
+                      __ATOMIC_RELAXED);
+  while (usec > max &&
+         !__atomic_compare_exchange_n (&maxima[hist], &max, usec, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+  {
+  }
+}
+
+/* stats_format - write all statistics as "name value" lines
+
+   The report ends with an empty line.  Returns the length written,
+   which is truncated to len - 1 if the buffer is too small.
+*/
+size_t
+stats_format (char *buf,
+              size_t len)
+{
+  size_t n;
+  int    i;
+
+  n = snprintf (buf, len, "uptime_s %lu\n", stats_elapsed_us (&started)
+                / 1000000);
+  for (i = 0; i < STAT_MAX && n < len; i++)
+  {
+    n += snprintf (buf + n, len - n, "%s %lu\n", counter_names[i],
+                   __atomic_load_n (&stats_counters[i], __ATOMIC_RELAXED));
+  }
+  for (i = 0; i < HIST_MAX && n < len; i++)
+  {
+    n += format_hist (buf + n, len - n, (hist_t) i);
+  }
+  if (n < len)
+  {
+    n += snprintf (buf + n, len - n, "\n");
+  }
+  return (n < len)? n: len - 1;
+}
+
+/* bucket_index - log-linear bucket of a value, as in HdrHistogram
+
+   Values below SUB_COUNT have a bucket each, above that every power
+   of two is split into SUB_COUNT buckets.
+*/
+static unsigned int
+bucket_index (unsigned long value)
+{
+  int msb;
+
+  if (value < SUB_COUNT)
+  {
+    return (unsigned int) value;
+  }
+  if (value > 0xffffffffUL)     /* VALUE_BITS */
+  {
+    value = 0xffffffffUL;
+  }
+  msb = 8 * sizeof (value) - 1 - __builtin_clzl (value);
+  return ((msb - SUB_BITS + 1) << SUB_BITS) +
+    ((value >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+/* bucket_value - lowest value counted in a bucket */
+static unsigned long
+bucket_value (unsigned int index)
+{
+  if (index < SUB_COUNT)
+  {
+    return index;
+  }
+  return (unsigned long) (SUB_COUNT + (index & (SUB_COUNT - 1)))
+    << ((index >> SUB_BITS) - 1);
+}
+
+/* format_hist - write count, percentiles and maximum of a histogram */
+static size_t
+format_hist (char *buf,
+             size_t len,
+             hist_t hist)
+{
+  static const struct {
+    const char *name;
+    int         permille;
+  } pct[] = { {"p50", 500}, {"p90", 900}, {"p99", 990}, {"p999", 999} };
+  unsigned long counts[HIST_BUCKETS];
+  unsigned long total = 0, seen = 0;
+  unsigned int  i, p = 0;
+  size_t        n;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+  {
+    counts[i] = __atomic_load_n (&histograms[hist][i], __ATOMIC_RELAXED);
+    total    += counts[i];
+  }
+  n = snprintf (buf, len, "%s_count %lu\n", hist_names[hist], total);
+  for (i = 0; i < HIST_BUCKETS && p < sizeof (pct) / sizeof (pct[0]); i++)
+  {
+    seen += counts[i];
+    while (total && p < sizeof (pct) / sizeof (pct[0]) &&
+           seen * 1000 >= total * pct[p].permille && n < len)
+    {
+      n += snprintf (buf + n, len - n, "%s_%s %lu\n", hist_names[hist],
+                     pct[p].name, bucket_value (i));
+      p++;
+    }
+  }
+  for (; p < sizeof (pct) / sizeof (pct[0]) && n < len; p++)
+  {
+    n += snprintf (buf + n, len - n, "%s_%s 0\n", hist_names[hist],
+                   pct[p].name);
+  }
+  if (n < len)
+  {
+    n += snprintf (buf + n, len - n, "%s_max %lu\n", hist_names[hist],
+                   __atomic_load_n (&maxima[hist], __ATOMIC_RELAXED));
+  }
+  return n;
+}
@@ -0,0 +1,60 @@
+/* File: stats.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Runtime statistics of blinkd: counters and latency histograms,
+   updated with relaxed atomic operations from any thread and
+   reported as "name value" lines by stats_format(). */
+
+#include <stddef.h>
+#include <time.h>
+
+typedef enum {
+  STAT_CONNECTIONS,             /* stream connections accepted */
+  STAT_DATAGRAMS,               /* datagrams received */
+  STAT_RING_RECORDS,            /* records taken from the command ring */
+  STAT_RING_WAKEUPS,            /* futex wakeups by ring producers */
+  STAT_OCTETS,                  /* command octets decoded */
+  STAT_FRAMES,                  /* v2 frames decoded */
+  STAT_INVALID,                 /* octets that are no valid command */
+  STAT_BATCHES,                 /* rate changes queued for the scheduler */
+  STAT_QUEUE_FULL,              /* command queue full, retried later */
+  STAT_EDGES,                   /* pattern steps taken by all channels */
+  STAT_IOCTLS,                  /* LED backend reads and writes */
+  STAT_IOCTLS_FAILED,
+  STAT_IOCTLS_SAVED,            /* skipped thanks to the LED state cache */
+  STAT_CONSOLE_OPENS,           /* LED backend opens */
+  STAT_MAX
+} stat_t;
+
+typedef enum {
+  HIST_ACCEPT_DECODE,           /* connection accepted to first octet */
+  HIST_DECODE_APPLY,            /* rate change to LEDs set */
+  HIST_DEVICE_APPLY,            /* time spent in the LED backend */
+  HIST_MAX
+} hist_t;
+
+extern unsigned long stats_counters[STAT_MAX];
+
+#define STATS_ADD(stat, n) \
+  __atomic_fetch_add (&stats_counters[stat], (n), __ATOMIC_RELAXED)
+#define STATS_INC(stat) STATS_ADD (stat, 1)
+
+unsigned long stats_elapsed_us (const struct timespec *since);
+size_t        stats_format     (char *buf, size_t len);
+void          stats_record     (hist_t hist, unsigned long usec);
+void          stats_start      (void);
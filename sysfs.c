@@ -0,0 +1,354 @@
+/* File: sysfs.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* The sysfs backend writes the brightness of LED class devices, e.g.
+   on headless boxes without a console.  The argument names the
+   devices for the Caps-, Num- and Scroll-Lock LED separated by commas,
+   relative to /sys/class/leds unless absolute; an empty name skips an
+   LED.  By default the first "*::capslock", "*::numlock" and
+   "*::scrolllock" devices are used.  Any further names are panel LEDs,
+   numbered from 0, e.g. GPIO LEDs of a front panel.  The brightness
+   files stay open, every change is a single pwrite(). */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <linux/kd.h>
+
+#include <backend.h>
+
+/* macros */
+#define LEDS_DIR        "/sys/class/leds"
+#define NAME_SIZE       256
+#define VALUE_SIZE      16
+
+/* function prototypes */
+static int  add_panel      (void);
+static int  find_led       (const char *suffix, char *name);
+static int  next_name      (const char **next, char *name);
+static int  open_led       (const char *name, int *fd, char *max);
+static int  sysfs_apply    (int mask);
+static int  sysfs_close    (void);
+static int  sysfs_open     (const char *arg);
+static int  sysfs_read     (void);
+static int  sysfs_release  (void);
+static int  sysfs_set      (int panel, int on_off);
+
+/* global variables */
+const backend_t backend_sysfs =
+{
+  "sysfs", 0,
+  sysfs_open, sysfs_apply, sysfs_read, sysfs_close, sysfs_release,
+  NULL, NULL, sysfs_set
+};
+static const int   bits[3]     = { LED_CAP, LED_NUM, LED_SCR };
+static const char *suffixes[3] = { "::capslock", "::numlock", "::scrolllock" };
+static int         fds[3]      = { -1, -1, -1 }; /* brightness files */
+static char        on[3][VALUE_SIZE];            /* max_brightness */
+static int         current     = 0;
+static int         initial     = -1; /* state before the first open */
+static int        *panel_fds   = NULL;
+static char      (*panel_on)[VALUE_SIZE] = NULL;
+static int         npanels     = 0;
+
+/* sysfs_open - open the brightness files of all LEDs found */
+static int
+sysfs_open (const char *arg)
+{
+  const char *next = arg;
+  char        name[NAME_SIZE];
+  int         i, found = 0;
+
+  for (i = 0; i < 3; i++)
+  {
+    if (arg != NULL)
+    {
+      if (next_name (&next, name) == -1)
+      {
+        sysfs_close ();
+        return -1;
+      }
+      if (!*name)               /* LED skipped or not named */
+      {
+        continue;
+      }
+    }
+    else if (find_led (suffixes[i], name))
+    {
+      continue;                 /* the box has no such LED */
+    }
+    if (open_led (name, &fds[i], on[i]))
+    {
+      sysfs_close ();
+      return -1;
+    }
+    found++;
+  }
+  while (next != NULL)          /* panel LEDs */
+  {
+    if (next_name (&next, name) == -1 || add_panel () == -1 ||
+        (*name && open_led (name, &panel_fds[npanels - 1],
+                            panel_on[npanels - 1])))
+    {
+      sysfs_close ();
+      return -1;
+    }
+    found += (*name != '\0');
+  }
+  if (!found)
+  {
+    errno = ENODEV;
+    return -1;
+  }
+  if (initial == -1)
+  {
+    initial = sysfs_read ();
+  }
+  return 0;
+}
+
+/* add_panel - make room for one more panel LED, not opened yet */
+static int
+add_panel (void)
+{
+  int  *more_fds;
+  char (*more_on)[VALUE_SIZE];
+
+  if ((more_fds = realloc (panel_fds,
+                           (npanels + 1) * sizeof (*panel_fds))) == NULL)
+  {
+    return -1;
+  }
+  panel_fds = more_fds;
+  if ((more_on = realloc (panel_on,
+                          (npanels + 1) * sizeof (*panel_on))) == NULL)
+  {
+    return -1;
+  }
+  panel_on             = more_on;
+  panel_fds[npanels++] = -1;
+  return 0;
+}
+
+/* next_name - copy the next name of a comma separated list
+
+   next is NULL after the last one, an empty name means none.
+*/
+static int
+next_name (const char **next,
+           char *name)
+{
+  size_t len = (*next != NULL)? strcspn (*next, ","): 0;
+
+  if (len >= NAME_SIZE)
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if (len)
+  {
+    memcpy (name, *next, len);
+  }
+  name[len] = '\0';
+  if (*next != NULL)
+  {
+    *next = (*next)[len]? *next + len + 1: NULL;
+  }
+  return 0;
+}
+
+/* find_led - find the LED device with the lowest name ending in suffix */
+static int
+find_led (const char *suffix,
+          char *name)
+{
+  DIR           *dir;
+  struct dirent *de;
+  size_t         slen = strlen (suffix);
+  int            rc   = -1;
+
+  if ((dir = opendir (LEDS_DIR)) == NULL)
+  {
+    return -1;
+  }
+  while ((de = readdir (dir)) != NULL)
+  {
+    size_t len = strlen (de->d_name);
+
+    if (len > slen && len < NAME_SIZE &&
+        !strcmp (de->d_name + len - slen, suffix) &&
+        (rc || strcmp (de->d_name, name) < 0))
+    {
+      strcpy (name, de->d_name);
+      rc = 0;
+    }
+  }
+  closedir (dir);
+  return rc;
+}
+
+/* open_led - open the brightness file of one LED, read its maximum */
+static int
+open_led (const char *name,
+          int *fd_out,
+          char *max)
+{
+  char    path[NAME_SIZE + sizeof (LEDS_DIR "/max_brightness")];
+  int     fd;
+  ssize_t rr;
+
+  snprintf (path, sizeof (path), (*name == '/')? "%s/max_brightness":
+            LEDS_DIR "/%s/max_brightness", name);
+  if ((fd = open (path, O_RDONLY | O_CLOEXEC)) == -1)
+  {
+    return -1;
+  }
+  rr = read (fd, max, VALUE_SIZE - 1);
+  close (fd);
+  if (rr <= 0)
+  {
+    errno = rr? errno: EIO;
+    return -1;
+  }
+  max[rr] = '\0';
+  max[strcspn (max, "\n")] = '\0';
+  snprintf (path, sizeof (path), (*name == '/')? "%s/brightness":
+            LEDS_DIR "/%s/brightness", name);
+  return ((*fd_out = open (path, O_RDWR | O_CLOEXEC)) == -1)? -1: 0;
+}
+
+/* sysfs_apply - write the brightness of the LEDs that change */
+static int
+sysfs_apply (int mask)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+  {
+    const char *value = (mask & bits[i])? on[i]: "0";
+
+    if (fds[i] != -1 && ((mask ^ current) & bits[i]) &&
+        pwrite (fds[i], value, strlen (value), 0) == -1)
+    {
+      return -1;
+    }
+  }
+  current = mask;
+  return 0;
+}
+
+/* sysfs_set - write the brightness of a panel LED */
+static int
+sysfs_set (int panel,
+           int on_off)
+{
+  const char *value;
+
+  if (panel >= npanels || panel_fds[panel] == -1)
+  {
+    errno = ENXIO;
+    return -1;
+  }
+  value = on_off? panel_on[panel]: "0";
+  return (pwrite (panel_fds[panel], value, strlen (value), 0) == -1)? -1: 0;
+}
+
+/* sysfs_read - read the brightness of all LEDs */
+static int
+sysfs_read (void)
+{
+  char    value[VALUE_SIZE];
+  ssize_t rr;
+  int     i;
+
+  current = 0;
+  for (i = 0; i < 3; i++)
+  {
+    if (fds[i] == -1)
+    {
+      continue;
+    }
+    if ((rr = pread (fds[i], value, sizeof (value) - 1, 0)) < 0)
+    {
+      return -1;
+    }
+    value[rr] = '\0';
+    if (atoi (value))
+    {
+      current |= bits[i];
+    }
+  }
+  return current;
+}
+
+/* sysfs_close - close all brightness files */
+static int
+sysfs_close (void)
+{
+  int i, rc = 0;
+
+  for (i = 0; i < 3; i++)
+  {
+    if (fds[i] != -1 && close (fds[i]) == -1)
+    {
+      rc = -1;
+    }
+    fds[i] = -1;
+  }
+  for (i = 0; i < npanels; i++)
+  {
+    if (panel_fds[i] != -1 && close (panel_fds[i]) == -1)
+    {
+      rc = -1;
+    }
+  }
+  free (panel_fds);
+  free (panel_on);
+  panel_fds = NULL;
+  panel_on  = NULL;
+  npanels   = 0;
+  return rc;
+}
+
+/* sysfs_release - restore the LEDs as they were before blinkd, switch
+   the panel LEDs off */
+static int
+sysfs_release (void)
+{
+  int i, rc = 0;
+
+  for (i = 0; i < npanels; i++)
+  {
+    if (panel_fds[i] != -1 && sysfs_set (i, 0) == -1)
+    {
+      rc = -1;
+    }
+  }
+  if (initial == -1)
+  {
+    return rc;
+  }
+  current = ~initial;           /* write all of them */
+  return (sysfs_apply (initial) == -1)? -1: rc;
+}
@@ -0,0 +1,294 @@
+/* File: watch.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/inotify.h>
+
+#include <watch.h>
+
+/* macros */
+#define HASH_SIZE       1024    /* chains per table */
+#define WATCH_EVENTS    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                         IN_MOVED_TO | IN_Q_OVERFLOW)
+#define INOTIFY_BUFSIZE (16 * (sizeof (struct inotify_event) + NAME_MAX + 1))
+
+/* type definitions */
+typedef struct entry {
+  struct entry *next;
+  int           count;          /* files of a message */
+  char          name[1];        /* allocated as long as needed */
+} entry_t;
+
+struct watch {
+  int         fd;
+  const char *dir;
+  const char *separators;
+  int         messages;         /* distinct messages */
+  entry_t    *files[HASH_SIZE];
+  entry_t    *stems[HASH_SIZE];
+};
+
+/* function prototypes */
+static void      add_file    (watch_t *w, const char *name);
+static void      clear_table (entry_t **table);
+static entry_t **lookup      (entry_t **table, const char *name,
+                              size_t len);
+static int       new_entry   (entry_t **link, const char *name, size_t len);
+static void      remove_file (watch_t *w, const char *name);
+static int       scan        (watch_t *w);
+
+/* watch_new - start watching a directory and count what is in it
+
+   Returns NULL with errno set if the directory cannot be watched.
+*/
+watch_t *
+watch_new (const char *dir,
+           const char *separators)
+{
+  watch_t *w;
+
+  if ((w = calloc (1, sizeof (*w))) == NULL)
+  {
+    return NULL;
+  }
+  w->dir        = dir;
+  w->separators = separators;
+  /* watch before reading the directory, so no file is missed */
+  if ((w->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) == -1 ||
+      inotify_add_watch (w->fd, dir, WATCH_EVENTS) == -1 ||
+      scan (w) == -1)
+  {
+    int saved = errno;
+
+    if (w->fd != -1)
+    {
+      close (w->fd);
+    }
+    free (w);
+    errno = saved;
+    return NULL;
+  }
+  return w;
+}
+
+/* watch_count - number of distinct messages */
+int
+watch_count (const watch_t *w)
+{
+  return w->messages;
+}
+
+/* watch_fd - the inotify fd to wait for */
+int
+watch_fd (const watch_t *w)
+{
+  return w->fd;
+}
+
+/* watch_read - follow the changes reported by inotify
+
+   After an overflow of the event queue the directory is read again.
+   Returns -1 with errno set if the directory is gone.
+*/
+int
+watch_read (watch_t *w)
+{
+  char    buf[INOTIFY_BUFSIZE];
+  ssize_t rr;
+  int     rescan = 0;
+
+  while ((rr = read (w->fd, buf, sizeof (buf))) > 0)
+  {
+    char *p = buf;
+
+    while (p < buf + rr)
+    {
+      struct inotify_event *ev = (struct inotify_event *) p;
+
+      if (ev->mask & IN_Q_OVERFLOW)
+      {
+        rescan = 1;
+      }
+      else if (ev->mask & IN_IGNORED)
+      {
+        clear_table (w->files);
+        clear_table (w->stems);
+        w->messages = 0;
+        errno = ENOENT;
+        return -1;
+      }
+      else if (ev->len && ev->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+        add_file (w, ev->name);
+      }
+      else if (ev->len && ev->mask & (IN_DELETE | IN_MOVED_FROM))
+      {
+        remove_file (w, ev->name);
+      }
+      p += sizeof (*ev) + ev->len;
+    }
+  }
+  if (rr == -1 && errno != EAGAIN && errno != EINTR)
+  {
+    return -1;
+  }
+  return rescan? scan (w): 0;
+}
+
+/* scan - count all files in the directory from scratch */
+static int
+scan (watch_t *w)
+{
+  DIR           *dir;
+  struct dirent *de;
+
+  clear_table (w->files);
+  clear_table (w->stems);
+  w->messages = 0;
+  if ((dir = opendir (w->dir)) == NULL)
+  {
+    return -1;
+  }
+  while ((de = readdir (dir)) != NULL)
+  {
+    add_file (w, de->d_name);
+  }
+  closedir (dir);
+  return 0;
+}
+
+/* add_file - count a new file, unless it is known or hidden */
+static void
+add_file (watch_t *w,
+          const char *name)
+{
+  entry_t **link;
+
+  if (*name == '.' ||
+      *(link = lookup (w->files, name, strlen (name))) != NULL ||
+      new_entry (link, name, strlen (name)))
+  {
+    return;
+  }
+  link = lookup (w->stems, name, strcspn (name, w->separators));
+  if (*link != NULL)
+  {
+    (*link)->count++;
+  }
+  else if (!new_entry (link, name, strcspn (name, w->separators)))
+  {
+    w->messages++;
+  }
+}
+
+/* remove_file - forget a file, and its message with the last file */
+static void
+remove_file (watch_t *w,
+             const char *name)
+{
+  entry_t **link = lookup (w->files, name, strlen (name));
+  entry_t  *e    = *link;
+
+  if (e == NULL)
+  {
+    return;
+  }
+  *link = e->next;
+  free (e);
+  link = lookup (w->stems, name, strcspn (name, w->separators));
+  if ((e = *link) != NULL && !--e->count)
+  {
+    *link = e->next;
+    free (e);
+    w->messages--;
+  }
+}
+
+/* lookup - find the link to the entry for the first len octets of name
+
+   If there is no such entry, the link at the end of its chain is
+   returned, pointing to NULL.
+*/
+static entry_t **
+lookup (entry_t **table,
+        const char *name,
+        size_t len)
+{
+  unsigned long hash = 5381;
+  size_t        i;
+  entry_t     **link;
+
+  for (i = 0; i < len; i++)
+  {
+    hash = hash * 33 + (unsigned char) name[i];
+  }
+  for (link = &table[hash % HASH_SIZE]; *link != NULL;
+       link = &(*link)->next)
+  {
+    if (!strncmp ((*link)->name, name, len) && !(*link)->name[len])
+    {
+      break;
+    }
+  }
+  return link;
+}
+
+/* new_entry - append an entry for the first len octets of name */
+static int
+new_entry (entry_t **link,
+           const char *name,
+           size_t len)
+{
+  entry_t *e;
+
+  if ((e = malloc (sizeof (*e) + len)) == NULL)
+  {
+    return -1;
+  }
+  memcpy (e->name, name, len);
+  e->name[len] = '\0';
+  e->count     = 1;
+  e->next      = NULL;
+  *link        = e;
+  return 0;
+}
+
+/* clear_table - free all entries of a table */
+static void
+clear_table (entry_t **table)
+{
+  int i;
+
+  for (i = 0; i < HASH_SIZE; i++)
+  {
+    while (table[i] != NULL)
+    {
+      entry_t *e = table[i];
+
+      table[i] = e->next;
+      free (e);
+    }
+  }
+}
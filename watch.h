@@ -0,0 +1,30 @@
+/* File: watch.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Spool directory watcher of blinkd: counts the distinct messages in a
+   directory, kept up to date through inotify.  Files belonging to the
+   same message share their name up to the first of a set of separator
+   characters, e.g. "." for "f1234.01" and "f1234.02".  Hidden files
+   are not counted. */
+
+typedef struct watch watch_t;
+
+watch_t *watch_new   (const char *dir, const char *separators);
+int      watch_count (const watch_t *w);
+int      watch_fd    (const watch_t *w);
+int      watch_read  (watch_t *w);
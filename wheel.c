@@ -0,0 +1,279 @@
+/* File: wheel.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <wheel.h>
+
+/* macros */
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+#define WHEEL_SPAN      ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+#define BIT(n)          ((uint64_t) 1 << (n))
+
+/* type definitions */
+typedef struct {
+  uint64_t expires;
+  int      next;                /* list of the slot, -1 at the end */
+  int      prev;                /* -1 at the head */
+  int      slot;                /* level * WHEEL_SLOTS + index, or -1 */
+} node_t;
+
+/* function prototypes */
+static int  cascade (int level);
+static void dequeue (int id);
+static void enqueue (int id);
+
+/* global variables */
+static node_t  *nodes = NULL;
+static int      heads[WHEEL_LEVELS * WHEEL_SLOTS];
+static uint64_t used[WHEEL_LEVELS];   /* bit per non-empty slot */
+static uint64_t base  = 0;            /* next tick to run */
+
+/* wheel_start - set up an empty wheel for n timers, 0 or -1 */
+int
+wheel_start (int n,
+             uint64_t now)
+{
+  int i;
+
+  free (nodes);
+  if ((nodes = malloc (n * sizeof (*nodes))) == NULL)
+  {
+    return -1;
+  }
+  for (i = 0; i < n; i++)
+  {
+    nodes[i].slot = -1;
+  }
+  for (i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+  {
+    heads[i] = -1;
+  }
+  for (i = 0; i < WHEEL_LEVELS; i++)
+  {
+    used[i] = 0;
+  }
+  base = now;
+  return 0;
+}
+
+/* wheel_add - (re)queue timer id for tick expires
+
+   Ticks already run expire with the next one.
+*/
+void
+wheel_add (int id,
+           uint64_t expires)
+{
+  dequeue (id);
+  nodes[id].expires = (expires < base)? base: expires;
+  enqueue (id);
+}
+
+/* wheel_del - dequeue timer id, if it is queued */
+void
+wheel_del (int id)
+{
+  dequeue (id);
+}
+
+/* wheel_next - the next tick wheel_run() has anything to do at
+
+   That is the earliest expiry, or earlier the end of a level 0 round
+   that cascades timers down.  WHEEL_NONE if no timer is queued.
+*/
+uint64_t
+wheel_next (void)
+{
+  uint64_t next = WHEEL_NONE;
+  int      level;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+  {
+    int      shift = WHEEL_BITS * level;
+    int      index = (base >> shift) & WHEEL_MASK;
+    uint64_t round = base >> (shift + WHEEL_BITS) << (shift + WHEEL_BITS);
+    uint64_t later, tick;
+    int      from;
+
+    if (!used[level])
+    {
+      continue;
+    }
+    /* the slot of the current index cascaded already, unless base is
+       just where it is due */
+    from  = (base & (BIT (shift) - 1))? index + 1: index;
+    later = (from > WHEEL_MASK)? 0: used[level] & (~(uint64_t) 0 << from);
+    if (later)
+    {
+      tick = round + ((uint64_t) __builtin_ctzll (later) << shift);
+    }
+    else
+    {
+      tick = round + BIT (shift + WHEEL_BITS) +
+             ((uint64_t) __builtin_ctzll (used[level]) << shift);
+    }
+    if (tick < next)
+    {
+      next = tick;
+    }
+  }
+  return next;
+}
+
+/* wheel_run - expire the timers of all ticks up to now
+
+   fire(id, arg) is called for each, and may add id again, but must
+   not touch any other timer.  Empty slots are skipped at once.
+*/
+void
+wheel_run (uint64_t now,
+           wheel_fire_t fire,
+           void *arg)
+{
+  while (base <= now)
+  {
+    int      index = base & WHEEL_MASK;
+    uint64_t later;
+    int      id;
+
+    if (!index)
+    {
+      int level;
+
+      for (level = 1; level < WHEEL_LEVELS && !cascade (level); level++)
+      {
+        ;
+      }
+    }
+    if (!(later = used[0] >> index))
+    {
+      /* nothing before the next round */
+      uint64_t round = (base | WHEEL_MASK) + 1;
+
+      base = (round <= now)? round: now + 1;
+      continue;
+    }
+    index += __builtin_ctzll (later);
+    base  += __builtin_ctzll (later);
+    if (base > now)
+    {
+      base = now + 1;
+      break;
+    }
+    id            = heads[index];
+    heads[index]  = -1;
+    used[0]      &= ~BIT (index);
+    base++;
+    while (id != -1)
+    {
+      int next = nodes[id].next;
+
+      nodes[id].slot = -1;
+      fire (id, arg);
+      id = next;
+    }
+  }
+}
+
+/* cascade - move the timers of the current slot of a level down,
+   return its index */
+static int
+cascade (int level)
+{
+  int index = (base >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  int slot  = level * WHEEL_SLOTS + index;
+  int id    = heads[slot];
+
+  heads[slot]   = -1;
+  used[level]  &= ~BIT (index);
+  while (id != -1)
+  {
+    int next = nodes[id].next;
+
+    nodes[id].slot = -1;
+    enqueue (id);
+    id = next;
+  }
+  return index;
+}
+
+/* enqueue - put a timer into the slot for its expiry */
+static void
+enqueue (int id)
+{
+  node_t  *n     = &nodes[id];
+  uint64_t delta = n->expires - base;
+  uint64_t at    = n->expires;
+  int      level = 0;
+  int      index;
+
+  if (delta >= WHEEL_SPAN)      /* as far as it reaches, then again */
+  {
+    delta = WHEEL_SPAN - 1;
+    at    = base + delta;
+  }
+  while (delta >= BIT (WHEEL_BITS * (level + 1)))
+  {
+    level++;
+  }
+  index       = (at >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  n->slot     = level * WHEEL_SLOTS + index;
+  n->prev     = -1;
+  n->next     = heads[n->slot];
+  if (n->next != -1)
+  {
+    nodes[n->next].prev = id;
+  }
+  heads[n->slot]  = id;
+  used[level]    |= BIT (index);
+}
+
+/* dequeue - take a timer out of its slot, if it is in one */
+static void
+dequeue (int id)
+{
+  node_t *n = &nodes[id];
+
+  if (n->slot == -1)
+  {
+    return;
+  }
+  if (n->prev != -1)
+  {
+    nodes[n->prev].next = n->next;
+  }
+  else
+  {
+    heads[n->slot] = n->next;
+  }
+  if (n->next != -1)
+  {
+    nodes[n->next].prev = n->prev;
+  }
+  if (heads[n->slot] == -1)
+  {
+    used[n->slot / WHEEL_SLOTS] &= ~BIT (n->slot % WHEEL_SLOTS);
+  }
+  n->slot = -1;
+}
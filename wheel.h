@@ -0,0 +1,36 @@
+/* File: wheel.h
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+   MA 02110-1301, USA.
+*/
+
+/* Hierarchical timer wheel of blinkd: timers of ids 0..n-1 expiring
+   at ticks of one milli second.  Adding, removing and expiring a timer
+   costs the same with any number of them.  Level 0 has a slot per tick
+   of the next 64, every further level slots 64 times as long, which
+   are cascaded down when the lower level wraps.  Only one thread may
+   use the wheel. */
+
+#include <stdint.h>
+
+#define WHEEL_NONE ((uint64_t) -1) /* no timer queued */
+
+typedef void (*wheel_fire_t) (int id, void *arg);
+
+void     wheel_add   (int id, uint64_t expires);
+void     wheel_del   (int id);
+uint64_t wheel_next  (void);
+void     wheel_run   (uint64_t now, wheel_fire_t fire, void *arg);
+int      wheel_start (int n, uint64_t now);